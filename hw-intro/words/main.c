@@ -30,19 +30,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "tokenizer.h"
 #include "word_count.h"
 // #define MAIN_DEBUG
 /* Global data structure tracking the words encountered */
 WordCount *word_counts = NULL;
 
-/* The maximum length of each word in a file */
-#define MAX_WORD_LEN 64
-
 /*
  * 3.1.1 Total Word Count
  *
  * Returns the total amount of words found in infile.
- * Useful functions: fgetc(), isalpha().
+ * Words are pulled from a block tokenizer instead of fgetc().
  */
 int num_words(FILE* infile) {
   int num_words = 0;
@@ -50,20 +48,18 @@ int num_words(FILE* infile) {
     perror("num_words:File is not open");
     return -1;
   }
-  int c;
-  int length=0;
-  while((c=fgetc(infile))!=EOF){
-    //get an alphabetic letter
-    if(isalpha(c)){
-      ++length;
-    }
-    //get a non-alphabetic letter could be ' ' or other
-    else{
-      if(length>1) ++num_words;
-      length=0;
-    }
+  WordTokenizer tok;
+  if(tokenizer_init(&tok,infile)!=0) return -1;
+  char *word;
+  ssize_t length;
+  while((length=tokenizer_next(&tok,&word))>0){
+    ++num_words;
+  }
+  tokenizer_destroy(&tok);
+  if(length<0){
+    perror("num_words:Fail to read the file");
+    return -1;
   }
-  if(length>1) ++num_words;
   return num_words;
 }
 
@@ -71,7 +67,8 @@ int num_words(FILE* infile) {
  * 3.1.2 Word Frequency Count
  *
  * Given infile, extracts and adds each word in the FILE to `wclist`.
- * Useful functions: fgetc(), isalpha(), tolower(), add_word().
+ * The tokenizer hands out lowercased views into its buffer, and
+ * add_word_copy() only copies a view when the word is new.
  * 
  * As mentioned in the spec, your code should not panic or
  * segfault on errors. Thus, this function should return
@@ -79,50 +76,29 @@ int num_words(FILE* infile) {
  * and 0 otherwise.
  */
 int count_words(WordCount **wclist, FILE *infile) {
-  if(!infile){
+  if(!wclist || !infile){
     perror("count_words:File is not open");
-    return -1;
+    return 1;
   }
-  int c;
-  int length=0;
-  char buffer[65];
-  while((c=fgetc(infile))!=EOF){
-    //get an alphabetic letter
+  WordTokenizer tok;
+  if(tokenizer_init(&tok,infile)!=0) return 1;
+  char *word;
+  ssize_t length;
+  while((length=tokenizer_next(&tok,&word))>0){
     #ifdef MAIN_DEBUG
-    printf("read a char:%c\n",c);
+    printf("add the word:%s\n",word);
     #endif
-    if(isalpha(c)){
-      buffer[length++]=tolower(c);
-    }
-    //get a non-alphabetic letter could be ' ' or other
-    else{
-      if(length>1) {
-        buffer[length]='\0';
-        char *str=malloc(sizeof(char)*length+1);
-        strcpy(str,buffer);
-        #ifdef MAIN_DEBUG
-        printf("add the word:%s\n",str);
-        #endif
-        if(add_word(wclist,str)!=0){
-          printf("ERROR:count_words()->add_word() fails");
-          return 1;
-        }
-      }
-      length=0;
-    }
-  }
-  if(length>1) {
-    buffer[length]='\0';
-    // printf("add the word:%s\n",buffer);
-    char *str=malloc(sizeof(char)*length+1);
-    strcpy(str,buffer);
-    if(add_word(wclist,str)!=0){
-      printf("ERROR:count_words()->add_word() fails");
+    if(add_word_copy(wclist,word)!=0){
+      printf("ERROR:count_words()->add_word_copy() fails");
+      tokenizer_destroy(&tok);
       return 1;
     }
   }
-  return 0;
-
+  tokenizer_destroy(&tok);
+  if(length<0){
+    perror("count_words:Fail to read the file");
+    return 1;
+  }
   return 0;
 }
 
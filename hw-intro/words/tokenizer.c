@@ -0,0 +1,111 @@
+/*
+word tokenizer reads a stream in large blocks and hands out words
+as views into its own buffer.
+
+Bytes are classified through a 256-entry table that maps every
+alphabetic byte to its lowercase form and everything else to 0,
+which replaces the per-character isalpha()/tolower() calls.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tokenizer.h"
+
+/* Lowercase form of each alphabetic byte, 0 for delimiters */
+static unsigned char lower_table[256];
+
+static void init_lower_table(void) {
+  if (lower_table['a'])
+    return;
+  for (int c = 'a'; c <= 'z'; c++) {
+    lower_table[c] = (unsigned char)c;
+    lower_table[c - 'a' + 'A'] = (unsigned char)c;
+  }
+}
+
+int tokenizer_init(WordTokenizer* tok, FILE* infile) {
+  if (tok == NULL || infile == NULL) {
+    printf("ERROR:tokenizer_init() pass in a NULL pointer\n");
+    return 1;
+  }
+  init_lower_table();
+  tok->buf = malloc(TOKENIZER_BLOCK_SIZE + 1);
+  if (tok->buf == NULL) {
+    printf("ERROR:tokenizer_init() fails to malloc the block buffer\n");
+    return 1;
+  }
+  tok->infile = infile;
+  tok->cap = TOKENIZER_BLOCK_SIZE;
+  tok->pos = 0;
+  tok->len = 0;
+  tok->eof = false;
+  tok->bytes = 0;
+  return 0;
+}
+
+/* Keep buf[keep..len) at the front of the buffer and read more data
+   behind it. The buffer is doubled when a single word fills it.
+   Returns 0 on success and -1 on error. */
+static int refill(WordTokenizer* tok, size_t keep) {
+  size_t rest = tok->len - keep;
+  if (keep == 0 && rest == tok->cap) {
+    char* bigger = realloc(tok->buf, tok->cap * 2 + 1);
+    if (bigger == NULL) {
+      printf("ERROR:tokenizer refill() fails to grow the block buffer\n");
+      return -1;
+    }
+    tok->buf = bigger;
+    tok->cap *= 2;
+  } else if (rest > 0) {
+    memmove(tok->buf, tok->buf + keep, rest);
+  }
+  size_t got = fread(tok->buf + rest, 1, tok->cap - rest, tok->infile);
+  if (got == 0) {
+    if (ferror(tok->infile))
+      return -1;
+    tok->eof = true;
+  }
+  tok->bytes += got;
+  tok->len = rest + got;
+  tok->pos = 0;
+  return 0;
+}
+
+ssize_t tokenizer_next(WordTokenizer* tok, char** word) {
+  for (;;) {
+    char* buf = tok->buf;
+    size_t len = tok->len;
+    size_t pos = tok->pos;
+    while (pos < len && !lower_table[(unsigned char)buf[pos]])
+      pos++;
+    size_t start = pos;
+    unsigned char c;
+    while (pos < len && (c = lower_table[(unsigned char)buf[pos]]) != 0)
+      buf[pos++] = (char)c;
+
+    if (pos == len && !tok->eof) {
+      /* The word at start may continue in the next block */
+      if (refill(tok, start) != 0)
+        return -1;
+      continue;
+    }
+
+    size_t n = pos - start;
+    /* Terminate over the delimiter, or the spare byte at end of input */
+    buf[pos] = '\0';
+    tok->pos = pos < len ? pos + 1 : pos;
+    if (n > 1) {
+      *word = buf + start;
+      return (ssize_t)n;
+    }
+    if (pos == len)
+      return 0;
+  }
+}
+
+void tokenizer_destroy(WordTokenizer* tok) {
+  free(tok->buf);
+  tok->buf = NULL;
+  tok->cap = tok->len = tok->pos = 0;
+}
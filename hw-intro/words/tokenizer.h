@@ -0,0 +1,41 @@
+/*
+word tokenizer reads a stream in large blocks and hands out words
+as views into its own buffer.
+
+A word is a run of two or more alphabetic characters. Each view is
+lowercased and NUL-terminated in place, and stays valid only until
+the next call to tokenizer_next().
+*/
+
+#ifndef tokenizer_h
+#define tokenizer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/* Bytes requested from the stream per read */
+#define TOKENIZER_BLOCK_SIZE (1 << 16)
+
+typedef struct word_tokenizer {
+  FILE* infile;
+  char* buf;    /* Block buffer, one spare byte for a terminator */
+  size_t cap;   /* Usable size of buf */
+  size_t pos;   /* Next byte to classify */
+  size_t len;   /* Bytes currently held in buf */
+  bool eof;     /* No more data will come from infile */
+  size_t bytes; /* Total bytes read from infile */
+} WordTokenizer;
+
+/* Prepare tok to read from infile. Returns 0 on success, 1 on error. */
+int tokenizer_init(WordTokenizer* tok, FILE* infile);
+
+/* Store the next word in *word and return its length.
+   Returns 0 at end of input and -1 on a read error. */
+ssize_t tokenizer_next(WordTokenizer* tok, char** word);
+
+/* Release the buffer owned by tok. */
+void tokenizer_destroy(WordTokenizer* tok);
+
+#endif /* tokenizer_h */
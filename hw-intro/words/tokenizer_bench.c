@@ -0,0 +1,101 @@
+/*
+
+  Tokenizer throughput benchmark
+
+  Usage: tokenizer_bench [-r rounds] file...
+
+  Scans each file with the original fgetc()/isalpha() loop and with
+  the block tokenizer, and reports the throughput of both in MB/s.
+
+*/
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tokenizer.h"
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The per-character loop num_words() used before the tokenizer */
+static long fgetc_words(FILE* infile, size_t* bytes) {
+  long words = 0;
+  int c;
+  int length = 0;
+  while ((c = fgetc(infile)) != EOF) {
+    ++*bytes;
+    if (isalpha(c)) {
+      ++length;
+    } else {
+      if (length > 1)
+        ++words;
+      length = 0;
+    }
+  }
+  if (length > 1)
+    ++words;
+  return words;
+}
+
+static long tokenizer_words(FILE* infile, size_t* bytes) {
+  WordTokenizer tok;
+  if (tokenizer_init(&tok, infile) != 0)
+    return -1;
+  long words = 0;
+  char* word;
+  while (tokenizer_next(&tok, &word) > 0)
+    ++words;
+  *bytes += tok.bytes;
+  tokenizer_destroy(&tok);
+  return words;
+}
+
+static int run(const char* name, long (*scan)(FILE*, size_t*), char** files, int nfiles,
+               int rounds) {
+  size_t bytes = 0;
+  long words = 0;
+  double start = now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < nfiles; i++) {
+      FILE* infile = fopen(files[i], "r");
+      if (!infile) {
+        perror(files[i]);
+        return 1;
+      }
+      words = scan(infile, &bytes);
+      fclose(infile);
+    }
+  }
+  double secs = now() - start;
+  printf("%-10s %10zu bytes %8.3f s %10.1f MB/s (%ld words in last file)\n", name, bytes, secs,
+         bytes / secs / 1e6, words);
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = 10;
+  int i;
+  while ((i = getopt(argc, argv, "r:")) != -1) {
+    switch (i) {
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-r rounds] file...\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc || rounds < 1) {
+    fprintf(stderr, "usage: %s [-r rounds] file...\n", argv[0]);
+    return 1;
+  }
+  if (run("fgetc", fgetc_words, argv + optind, argc - optind, rounds) != 0)
+    return 1;
+  return run("tokenizer", tokenizer_words, argv + optind, argc - optind, rounds);
+}
@@ -136,6 +136,36 @@ int add_word(WordCount** wclist, char* word) {
   return 0;
 }
 
+int add_word_copy(WordCount** wclist, const char* word) {
+  /* Increment the count of word if present. Otherwise insert a copy of it
+     with count 1, so callers may pass a view into a reusable buffer.
+     Returns 0 if no errors are encountered in the body of this function; 1 otherwise.
+  */
+  WordCount** link = wclist;
+  while (*link != NULL) {
+    if (strcmp((*link)->word, word) == 0) {
+      (*link)->count++;
+      return 0;
+    }
+    link = &(*link)->next;
+  }
+  WordCount* wc = malloc(sizeof(WordCount));
+  if (wc == NULL) {
+    printf("ERROR:add_word_copy() fails to malloc a new node\n");
+    return 1;
+  }
+  wc->word = new_string((char*)word);
+  if (wc->word == NULL) {
+    printf("ERROR:add_word_copy() fails to copy the word\n");
+    free(wc);
+    return 1;
+  }
+  wc->count = 1;
+  wc->next = NULL;
+  *link = wc;
+  return 0;
+}
+
 void fprint_words(WordCount* wchead, FILE* ofile) {
   /* print word counts to a file */
   WordCount* wc;
@@ -58,6 +58,9 @@ WordCount *find_word(WordCount *wchead, char *word);
 /* Insert word with count=1, if not already present; increment count if present. */
 int add_word(WordCount **wclist, char *word);
 
+/* Like add_word, but word is borrowed: a private copy is made only if it is new. */
+int add_word_copy(WordCount **wclist, const char *word);
+
 //static int wordcntcmp(const WordCount *wc1, WordCount *wc2);
 
 /* print word counts to a file */
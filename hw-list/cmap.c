@@ -0,0 +1,281 @@
+/*
+ * Implementation of the cmap interface.
+ */
+
+#include <stdlib.h>
+
+#include "cmap.h"
+
+/* Buckets in each segment of a fresh map */
+#define CMAP_MIN_BUCKETS 16
+
+/* A segment doubles its buckets once it holds this many elements per bucket */
+#define CMAP_MAX_LOAD 2
+
+static struct list* alloc_buckets(size_t nbuckets) {
+  struct list* buckets = malloc(nbuckets * sizeof(struct list));
+  if (buckets == NULL)
+    return NULL;
+  for (size_t i = 0; i < nbuckets; i++)
+    list_init(&buckets[i]);
+  return buckets;
+}
+
+/* Returns the segment that holds elements with hash H. */
+static inline struct cmap_segment* segment_of(struct cmap* map, uint64_t h) {
+  return &map->segments[h & (map->nsegments - 1)];
+}
+
+/* Returns the bucket of SEG that holds elements with hash H.
+   The segment bits are skipped so that every bucket is used. */
+static inline struct list* bucket_of(struct cmap* map, struct cmap_segment* seg, uint64_t h) {
+  return &seg->buckets[(h >> map->shift) & (seg->nbuckets - 1)];
+}
+
+/* Returns the element of BUCKET equal to KEY, or a null pointer. */
+static struct list_elem* find_elem(struct cmap* map, struct list* bucket,
+                                   const struct list_elem* key) {
+  struct list_elem* e;
+  for (e = list_begin(bucket); e != list_end(bucket); e = list_next(e))
+    if (map->equal(e, key, map->aux))
+      return e;
+  return NULL;
+}
+
+/* Doubles the buckets of SEG, whose lock must be held. Only this
+   segment is blocked while its elements are redistributed. If memory
+   runs out the segment simply stays at its current size. */
+static void grow_segment(struct cmap* map, struct cmap_segment* seg) {
+  size_t old_nbuckets = seg->nbuckets;
+  struct list* old = seg->buckets;
+  struct list* buckets = alloc_buckets(old_nbuckets * 2);
+  if (buckets == NULL)
+    return;
+
+  seg->buckets = buckets;
+  seg->nbuckets = old_nbuckets * 2;
+  for (size_t i = 0; i < old_nbuckets; i++) {
+    while (!list_empty(&old[i])) {
+      struct list_elem* e = list_pop_front(&old[i]);
+      list_push_front(bucket_of(map, seg, map->hash(e, map->aux)), e);
+    }
+  }
+  free(old);
+}
+
+/* Inserts E into SEG, whose lock must be held. */
+static void insert_elem(struct cmap* map, struct cmap_segment* seg, struct list* bucket,
+                        struct list_elem* e) {
+  list_push_front(bucket, e);
+  if (++seg->size > seg->nbuckets * CMAP_MAX_LOAD)
+    grow_segment(map, seg);
+}
+
+/* Initializes MAP to compute hash values using HASH and compare
+   elements using EQUAL, given auxiliary data AUX. The map is split
+   into NSEGMENTS independently locked segments, rounded up to a
+   power of two; a few times the number of threads is a good choice. */
+bool cmap_init(struct cmap* map, size_t nsegments, cmap_hash_func* hash, cmap_equal_func* equal,
+               void* aux) {
+  map->nsegments = 1;
+  map->shift = 0;
+  while (map->nsegments < nsegments) {
+    map->nsegments *= 2;
+    map->shift++;
+  }
+  map->hash = hash;
+  map->equal = equal;
+  map->aux = aux;
+
+  /* Segments are cache-line aligned so their locks do not share lines */
+  void* segments;
+  if (posix_memalign(&segments, 64, map->nsegments * sizeof(struct cmap_segment)) != 0)
+    return false;
+  map->segments = segments;
+  for (size_t i = 0; i < map->nsegments; i++) {
+    struct cmap_segment* seg = &map->segments[i];
+    seg->buckets = alloc_buckets(CMAP_MIN_BUCKETS);
+    if (seg->buckets == NULL) {
+      while (i-- > 0) {
+        free(map->segments[i].buckets);
+        pthread_mutex_destroy(&map->segments[i].lock);
+      }
+      free(map->segments);
+      return false;
+    }
+    seg->nbuckets = CMAP_MIN_BUCKETS;
+    seg->size = 0;
+    pthread_mutex_init(&seg->lock, NULL);
+  }
+  return true;
+}
+
+/* Destroys MAP. If DESTRUCTOR is non-null, it is first called for
+   each element in the map. No other thread may be using MAP. */
+void cmap_destroy(struct cmap* map, cmap_action_func* destructor) {
+  for (size_t i = 0; i < map->nsegments; i++) {
+    struct cmap_segment* seg = &map->segments[i];
+    for (size_t b = 0; b < seg->nbuckets; b++) {
+      while (!list_empty(&seg->buckets[b])) {
+        struct list_elem* e = list_pop_front(&seg->buckets[b]);
+        if (destructor != NULL)
+          destructor(e, map->aux);
+      }
+    }
+    free(seg->buckets);
+    pthread_mutex_destroy(&seg->lock);
+  }
+  free(map->segments);
+  map->segments = NULL;
+}
+
+/* Inserts NEW into MAP if no equal element is already present,
+   returning a null pointer. If an equal element is already in the
+   map, returns it without inserting NEW. */
+struct list_elem* cmap_insert(struct cmap* map, struct list_elem* new) {
+  uint64_t h = map->hash(new, map->aux);
+  struct cmap_segment* seg = segment_of(map, h);
+  pthread_mutex_lock(&seg->lock);
+  struct list* bucket = bucket_of(map, seg, h);
+  struct list_elem* old = find_elem(map, bucket, new);
+  if (old == NULL)
+    insert_elem(map, seg, bucket, new);
+  pthread_mutex_unlock(&seg->lock);
+  return old;
+}
+
+/* Finds the element equal to KEY, first inserting the element
+   returned by CREATE(KEY, ARG) if there is none, and then calls
+   UPDATE(element, ARG) if UPDATE is non-null. Both callbacks run
+   with the element's segment locked, so the whole read-modify-write
+   is atomic with respect to other cmap calls. Returns the element,
+   or a null pointer if CREATE returned one. */
+struct list_elem* cmap_upsert(struct cmap* map, const struct list_elem* key,
+                              cmap_create_func* create, cmap_action_func* update, void* arg) {
+  uint64_t h = map->hash(key, map->aux);
+  struct cmap_segment* seg = segment_of(map, h);
+  pthread_mutex_lock(&seg->lock);
+  struct list* bucket = bucket_of(map, seg, h);
+  struct list_elem* e = find_elem(map, bucket, key);
+  if (e == NULL) {
+    e = create(key, arg);
+    if (e != NULL)
+      insert_elem(map, seg, bucket, e);
+  }
+  if (e != NULL && update != NULL)
+    update(e, arg);
+  pthread_mutex_unlock(&seg->lock);
+  return e;
+}
+
+/* Finds and returns an element equal to KEY in MAP, or a null
+   pointer if none exists. The element may be deleted by another
+   thread as soon as this returns; callers that delete concurrently
+   should use cmap_upsert() instead. */
+struct list_elem* cmap_find(struct cmap* map, const struct list_elem* key) {
+  uint64_t h = map->hash(key, map->aux);
+  struct cmap_segment* seg = segment_of(map, h);
+  pthread_mutex_lock(&seg->lock);
+  struct list_elem* e = find_elem(map, bucket_of(map, seg, h), key);
+  pthread_mutex_unlock(&seg->lock);
+  return e;
+}
+
+/* Finds, removes, and returns an element equal to KEY in MAP, or a
+   null pointer if none exists. Freeing the element is the caller's
+   responsibility. */
+struct list_elem* cmap_delete(struct cmap* map, const struct list_elem* key) {
+  uint64_t h = map->hash(key, map->aux);
+  struct cmap_segment* seg = segment_of(map, h);
+  pthread_mutex_lock(&seg->lock);
+  struct list_elem* e = find_elem(map, bucket_of(map, seg, h), key);
+  if (e != NULL) {
+    list_remove(e);
+    seg->size--;
+  }
+  pthread_mutex_unlock(&seg->lock);
+  return e;
+}
+
+/* Initializes I for iterating MAP, locking its first segment.
+
+   Iteration idiom:
+
+      struct cmap_iterator i;
+      struct list_elem* e;
+
+      cmap_first(&i, map);
+      while ((e = cmap_next(&i)) != NULL)
+        {
+          struct foo* f = list_entry(e, struct foo, elem);
+          ...do something with f...
+        }
+
+   A loop that stops before cmap_next() returns a null pointer must
+   call cmap_iter_end() to unlock the current segment. */
+void cmap_first(struct cmap_iterator* i, struct cmap* map) {
+  i->map = map;
+  i->segment = 0;
+  i->bucket = 0;
+  i->elem = NULL;
+  pthread_mutex_lock(&map->segments[0].lock);
+}
+
+/* Advances I to the next element and returns it, or returns a null
+   pointer once every segment has been visited. */
+struct list_elem* cmap_next(struct cmap_iterator* i) {
+  struct cmap* map = i->map;
+  while (i->segment < map->nsegments) {
+    struct cmap_segment* seg = &map->segments[i->segment];
+    struct list* bucket = &seg->buckets[i->bucket];
+    i->elem = i->elem == NULL ? list_begin(bucket) : list_next(i->elem);
+    if (i->elem != list_end(bucket))
+      return i->elem;
+
+    i->elem = NULL;
+    if (++i->bucket == seg->nbuckets) {
+      pthread_mutex_unlock(&seg->lock);
+      i->bucket = 0;
+      if (++i->segment < map->nsegments)
+        pthread_mutex_lock(&map->segments[i->segment].lock);
+    }
+  }
+  return NULL;
+}
+
+/* Stops iteration early, unlocking the segment I is visiting. */
+void cmap_iter_end(struct cmap_iterator* i) {
+  if (i->segment < i->map->nsegments) {
+    pthread_mutex_unlock(&i->map->segments[i->segment].lock);
+    i->segment = i->map->nsegments;
+  }
+}
+
+/* Moves every element of MAP onto the end of LIST, one segment at a
+   time. */
+void cmap_drain(struct cmap* map, struct list* list) {
+  for (size_t i = 0; i < map->nsegments; i++) {
+    struct cmap_segment* seg = &map->segments[i];
+    pthread_mutex_lock(&seg->lock);
+    for (size_t b = 0; b < seg->nbuckets; b++)
+      while (!list_empty(&seg->buckets[b]))
+        list_push_back(list, list_pop_front(&seg->buckets[b]));
+    seg->size = 0;
+    pthread_mutex_unlock(&seg->lock);
+  }
+}
+
+/* Returns the number of elements in MAP. With concurrent writers
+   this is only a snapshot of each segment in turn. */
+size_t cmap_size(struct cmap* map) {
+  size_t size = 0;
+  for (size_t i = 0; i < map->nsegments; i++) {
+    pthread_mutex_lock(&map->segments[i].lock);
+    size += map->segments[i].size;
+    pthread_mutex_unlock(&map->segments[i].lock);
+  }
+  return size;
+}
+
+/* Returns true if MAP contains no elements. */
+bool cmap_empty(struct cmap* map) { return cmap_size(map) == 0; }
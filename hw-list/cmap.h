@@ -0,0 +1,94 @@
+/*
+ * The cmap interface is a concurrent hash map whose elements are embedded
+ * Pintos list_elems, in the same intrusive style as list.h.
+ *
+ * The buckets are split into segments by the low bits of each hash, and
+ * each segment has its own lock, bucket array and element count. Threads
+ * working on different segments never contend, and a segment that grows
+ * past its load factor rehashes itself under its own lock while every
+ * other segment stays available, so the map never stops the world to
+ * resize.
+ *
+ * Elements are typically embedded in a larger structure, e.g.:
+ *
+ *   struct foo {
+ *     char* key;
+ *     struct list_elem elem;
+ *   };
+ *
+ * and recovered from a list_elem pointer with list_entry().
+ */
+
+#ifndef CMAP_H
+#define CMAP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+/* Returns the hash of element E. */
+typedef uint64_t cmap_hash_func(const struct list_elem* e, void* aux);
+
+/* Returns true if A and B have equal keys. */
+typedef bool cmap_equal_func(const struct list_elem* a, const struct list_elem* b, void* aux);
+
+/* Returns a new element with the same key as KEY, for cmap_upsert(). */
+typedef struct list_elem* cmap_create_func(const struct list_elem* key, void* aux);
+
+/* Performs some operation on element E. */
+typedef void cmap_action_func(struct list_elem* e, void* aux);
+
+/* One lock-protected slice of the map. */
+struct cmap_segment {
+  pthread_mutex_t lock;
+  struct list* buckets;
+  size_t nbuckets; /* Always a power of two */
+  size_t size;     /* Number of elements in this segment */
+} __attribute__((aligned(64)));
+
+struct cmap {
+  struct cmap_segment* segments;
+  size_t nsegments; /* Always a power of two */
+  unsigned shift;   /* log2(nsegments), hash bits used to pick a segment */
+  cmap_hash_func* hash;
+  cmap_equal_func* equal;
+  void* aux;
+};
+
+/*
+ * Iterates over a cmap. The segment being visited stays locked until the
+ * iterator moves past it, so other threads may keep using the rest of the
+ * map, but the loop body must not modify the map itself.
+ */
+struct cmap_iterator {
+  struct cmap* map;
+  size_t segment;
+  size_t bucket;
+  struct list_elem* elem;
+};
+
+/* Basic life cycle. NSEGMENTS is rounded up to a power of two. */
+bool cmap_init(struct cmap*, size_t nsegments, cmap_hash_func*, cmap_equal_func*, void* aux);
+void cmap_destroy(struct cmap*, cmap_action_func*);
+
+/* Search, insertion, deletion. */
+struct list_elem* cmap_insert(struct cmap*, struct list_elem*);
+struct list_elem* cmap_upsert(struct cmap*, const struct list_elem* key, cmap_create_func*,
+                              cmap_action_func*, void* arg);
+struct list_elem* cmap_find(struct cmap*, const struct list_elem*);
+struct list_elem* cmap_delete(struct cmap*, const struct list_elem*);
+
+/* Bulk output. */
+void cmap_first(struct cmap_iterator*, struct cmap*);
+struct list_elem* cmap_next(struct cmap_iterator*);
+void cmap_iter_end(struct cmap_iterator*);
+void cmap_drain(struct cmap*, struct list*);
+
+/* Information. */
+size_t cmap_size(struct cmap*);
+bool cmap_empty(struct cmap*);
+
+#endif /* CMAP_H */
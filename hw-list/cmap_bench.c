@@ -0,0 +1,235 @@
+/*
+ * Stress test and scaling benchmark for cmap.
+ *
+ * Usage: cmap_bench [-t max_threads] [-n ops] [-k keys] [-s segments]
+ *
+ * The stress phase runs max_threads threads that concurrently upsert
+ * shared keys, insert and delete private keys, and iterate the whole map,
+ * then checks every count against the threads' own tallies. The scaling
+ * phase runs the same upsert workload with 1, 2, 4, ... max_threads
+ * threads, once with the given number of segments and once with a single
+ * segment (one global lock), and reports throughput.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmap.h"
+
+struct item {
+  uint64_t key;
+  long count;
+  struct list_elem elem;
+};
+
+struct bench {
+  struct cmap map;
+  long ops;       /* Operations per thread */
+  uint64_t nkeys; /* Size of the shared key space */
+  bool stress;
+  int nthreads;
+};
+
+struct thread {
+  struct bench* bench;
+  int id;
+  long* tally; /* Upserts of each shared key by this thread */
+  long bad;    /* Inconsistencies seen by this thread */
+  pthread_t tid;
+};
+
+static uint64_t mix(uint64_t x) {
+  /* splitmix64 finalizer */
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static uint64_t item_hash(const struct list_elem* e, void* aux) {
+  return mix(list_entry(e, struct item, elem)->key);
+}
+
+static bool item_equal(const struct list_elem* a, const struct list_elem* b, void* aux) {
+  return list_entry(a, struct item, elem)->key == list_entry(b, struct item, elem)->key;
+}
+
+static struct list_elem* item_create(const struct list_elem* key, void* aux) {
+  struct item* it = malloc(sizeof(struct item));
+  if (it == NULL)
+    return NULL;
+  it->key = list_entry(key, struct item, elem)->key;
+  it->count = 0;
+  return &it->elem;
+}
+
+static void item_bump(struct list_elem* e, void* aux) { list_entry(e, struct item, elem)->count++; }
+
+static void item_free(struct list_elem* e, void* aux) { free(list_entry(e, struct item, elem)); }
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* run(void* arg) {
+  struct thread* t = arg;
+  struct bench* b = t->bench;
+  uint64_t rng = mix(t->id + 1);
+  uint64_t private = b->nkeys + (uint64_t)t->id * b->ops;
+  struct item probe;
+
+  for (long i = 0; i < b->ops; i++) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    probe.key = rng % b->nkeys;
+    if (cmap_upsert(&b->map, &probe.elem, item_create, item_bump, NULL) == NULL)
+      t->bad++;
+    if (!b->stress)
+      continue;
+    t->tally[probe.key]++;
+
+    /* Keys above nkeys belong to this thread alone */
+    if (i % 8 == 0 && i + 4 < b->ops) {
+      struct item* it = malloc(sizeof(struct item));
+      it->key = private + i;
+      it->count = 0;
+      if (cmap_insert(&b->map, &it->elem) != NULL)
+        t->bad++;
+    } else if (i % 8 == 4) {
+      probe.key = private + i - 4;
+      struct list_elem* e = cmap_delete(&b->map, &probe.elem);
+      if (e == NULL)
+        t->bad++;
+      else
+        item_free(e, NULL);
+    }
+
+    /* One thread walks the map while the others keep writing */
+    if (t->id == 0 && i % (b->ops / 4 + 1) == 0) {
+      struct cmap_iterator it;
+      struct list_elem* e;
+      size_t n = 0;
+      cmap_first(&it, &b->map);
+      while ((e = cmap_next(&it)) != NULL)
+        n++;
+      if (n > b->nkeys + (uint64_t)b->nthreads * b->ops)
+        t->bad++;
+    }
+  }
+  return NULL;
+}
+
+/* Runs NTHREADS threads over a fresh map and returns the elapsed time, or
+   a negative value if the stress checks failed. */
+static double trial(int nthreads, size_t nsegments, long total_ops, uint64_t nkeys, bool stress) {
+  struct bench b;
+  struct thread threads[nthreads];
+  if (!cmap_init(&b.map, nsegments, item_hash, item_equal, NULL)) {
+    perror("cmap_init");
+    exit(1);
+  }
+  b.ops = total_ops / nthreads;
+  b.nkeys = nkeys;
+  b.stress = stress;
+  b.nthreads = nthreads;
+
+  double start = now();
+  for (int i = 0; i < nthreads; i++) {
+    threads[i].bench = &b;
+    threads[i].id = i;
+    threads[i].bad = 0;
+    threads[i].tally = stress ? calloc(nkeys, sizeof(long)) : NULL;
+    pthread_create(&threads[i].tid, NULL, run, &threads[i]);
+  }
+  for (int i = 0; i < nthreads; i++)
+    pthread_join(threads[i].tid, NULL);
+  double elapsed = now() - start;
+
+  long bad = 0;
+  for (int i = 0; i < nthreads; i++)
+    bad += threads[i].bad;
+  if (stress) {
+    /* Every private key was deleted again; shared counts must match */
+    size_t touched = 0;
+    struct item probe;
+    for (uint64_t k = 0; k < nkeys; k++) {
+      long expect = 0;
+      for (int i = 0; i < nthreads; i++)
+        expect += threads[i].tally[k];
+      probe.key = k;
+      struct list_elem* e = cmap_find(&b.map, &probe.elem);
+      long got = e == NULL ? 0 : list_entry(e, struct item, elem)->count;
+      if (got != expect) {
+        fprintf(stderr, "key %lu: count %ld, expected %ld\n", (unsigned long)k, got, expect);
+        bad++;
+      }
+      touched += expect > 0;
+    }
+    if (cmap_size(&b.map) != touched) {
+      fprintf(stderr, "map holds %zu elements, expected %zu\n", cmap_size(&b.map), touched);
+      bad++;
+    }
+    for (int i = 0; i < nthreads; i++)
+      free(threads[i].tally);
+  }
+  cmap_destroy(&b.map, item_free);
+  return bad ? -1 : elapsed;
+}
+
+int main(int argc, char* argv[]) {
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+  long ops = 4000000;
+  uint64_t nkeys = 100000;
+  size_t nsegments = 64;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:k:s:")) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'n':
+        ops = atol(optarg);
+        break;
+      case 'k':
+        nkeys = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        nsegments = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t max_threads] [-n ops] [-k keys] [-s segments]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (max_threads < 1 || ops < max_threads || nkeys < 1 || nsegments < 1) {
+    fprintf(stderr, "%s: invalid arguments\n", argv[0]);
+    return 1;
+  }
+
+  double t = trial(max_threads, nsegments, ops, nkeys, true);
+  if (t < 0) {
+    printf("stress: FAILED\n");
+    return 1;
+  }
+  printf("stress: %d threads, %ld ops, ok (%.3f s)\n", max_threads, ops, t);
+
+  printf("%8s %14s %14s\n", "threads", "Mops/s", "Mops/s (1 lock)");
+  for (int n = 1;; n *= 2) {
+    if (n > max_threads)
+      n = max_threads;
+    double striped = trial(n, nsegments, ops, nkeys, false);
+    double single = trial(n, 1, ops, nkeys, false);
+    printf("%8d %14.2f %14.2f\n", n, ops / striped / 1e6, ops / single / 1e6);
+    if (n == max_threads)
+      break;
+  }
+  return 0;
+}
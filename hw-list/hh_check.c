@@ -0,0 +1,160 @@
+/*
+ * Accuracy check for the approximate heavy-hitter summaries in word_summary.
+ *
+ * Usage: hh_check [-e epsilon] [-m bytes] [-k K] [-p parts] file...
+ *
+ * Counts the words of the files exactly in a word_table and approximately
+ * in PARTS Space-Saving summaries, each fed an interleaved share of the
+ * words, which are then merged the way pwords merges per-thread summaries.
+ * Reports how many of the exact top K words the summary's top K found, the
+ * largest overcount seen against the N/m bound, and any estimate whose
+ * bounds do not hold: count - error <= true count <= count.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "word_heap.h"
+#include "word_helpers.h"
+#include "word_summary.h"
+#include "word_table.h"
+
+/* Words handed to one part before moving on to the next */
+#define PART_RUN 4096
+
+struct check {
+  word_table_t exact;
+  word_summary_t* parts;
+  int nparts;
+  long nwords;
+};
+
+static void count_both(const char* word, size_t len, void* aux) {
+  struct check* c = aux;
+  word_table_add(&c->exact, word, len, 1);
+  word_summary_add(&c->parts[(c->nwords / PART_RUN) % c->nparts], word, len);
+  c->nwords++;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "usage: %s [-e epsilon] [-m bytes] [-k K] [-p parts] file...\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+  double epsilon = 0.001;
+  long memory = 0;
+  size_t k = 100;
+  int nparts = 4;
+  int opt;
+  while ((opt = getopt(argc, argv, "e:m:k:p:")) != -1) {
+    switch (opt) {
+      case 'e':
+        epsilon = atof(optarg);
+        break;
+      case 'm':
+        memory = atol(optarg);
+        break;
+      case 'k':
+        k = atol(optarg);
+        break;
+      case 'p':
+        nparts = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc || nparts < 1 || k < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  struct check c;
+  size_t cap = word_summary_capacity(epsilon, memory);
+  word_table_init(&c.exact);
+  c.nparts = nparts;
+  c.nwords = 0;
+  c.parts = malloc(nparts * sizeof(word_summary_t));
+  for (int p = 0; p < nparts; p++) {
+    if (c.parts == NULL || !word_summary_init(&c.parts[p], cap)) {
+      perror("malloc fails");
+      return 1;
+    }
+  }
+
+  for (int f = optind; f < argc; f++) {
+    FILE* infile = fopen(argv[f], "r");
+    if (infile == NULL) {
+      perror(argv[f]);
+      return 1;
+    }
+    if (scan_stream(infile, count_both, &c) != 0)
+      perror("fread fails");
+    fclose(infile);
+  }
+  for (int stride = 1; stride < nparts; stride *= 2)
+    for (int p = 0; p + stride < nparts; p += 2 * stride)
+      word_summary_merge(&c.parts[p], &c.parts[p + stride]);
+  word_summary_t* summary = &c.parts[0];
+
+  /* Check every kept estimate against the exact count */
+  long bound = word_summary_bound(summary);
+  long max_over = 0;
+  long violations = 0;
+  for (size_t i = 0; i < summary->size; i++) {
+    summary_entry_t* e = &summary->entries[i];
+    long truth = word_table_add(&c.exact, e->word, strlen(e->word), 0)->count;
+    if (e->count - truth > max_over)
+      max_over = e->count - truth;
+    if (truth > e->count || truth < e->count - e->error || e->error > bound)
+      violations++;
+  }
+
+  /* Compare the top K of both */
+  word_count_list_t exact_list;
+  init_words(&exact_list);
+  size_t distinct = c.exact.size;
+  word_table_drain(&c.exact, &exact_list);
+  if (k > distinct)
+    k = distinct;
+  word_heap_t heap;
+  summary_entry_t** approx_top = malloc(k * sizeof(summary_entry_t*));
+  if (approx_top == NULL || !word_heap_init(&heap, k, less_count)) {
+    perror("malloc fails");
+    return 1;
+  }
+  struct list_elem* e;
+  for (e = list_begin(&exact_list.lst); e != list_end(&exact_list.lst); e = list_next(e))
+    word_heap_offer(&heap, list_entry(e, word_count_t, elem));
+  size_t nexact = word_heap_drain(&heap, heap.items);
+  size_t napprox = word_summary_top(summary, k, approx_top);
+  size_t found = 0;
+  for (size_t i = 0; i < nexact; i++)
+    for (size_t j = 0; j < napprox; j++)
+      if (strcmp(heap.items[i]->word, approx_top[j]->word) == 0) {
+        found++;
+        break;
+      }
+
+  size_t exact_bytes = distinct * (sizeof(word_count_t) + sizeof(struct list) + 16);
+  size_t approx_bytes = summary->cap * (sizeof(summary_entry_t) + sizeof(summary_entry_t*) +
+                                        sizeof(struct list) + 16);
+  printf("words           %ld\n", summary->total);
+  printf("distinct        %zu (exact table ~%zu KiB)\n", distinct, exact_bytes >> 10);
+  printf("counters        %zu in %d parts (summary ~%zu KiB each)\n", summary->cap, nparts,
+         approx_bytes >> 10);
+  printf("error bound     %ld\n", bound);
+  printf("max overcount   %ld\n", max_over);
+  printf("top-%zu recall   %zu/%zu\n", k, found, nexact);
+  printf("violations      %ld\n", violations);
+
+  word_heap_destroy(&heap);
+  free(approx_top);
+  for (int p = 0; p < nparts; p++)
+    word_summary_destroy(&c.parts[p]);
+  free(c.parts);
+  return violations == 0 ? 0 : 1;
+}
@@ -0,0 +1,433 @@
+/*
+ * Benchmark of list layouts for the word count hot paths.
+ *
+ * Usage: list_bench [-m min_size] [-n max_size] [-b visits]
+ *
+ * For sizes from min_size to max_size, growing tenfold, measures four
+ * layouts of the same 16-byte records (a key and a count):
+ *   list      - Pintos list.c, one malloc'd node per record, as
+ *               word_count_p.c allocates them
+ *   shuffled  - list.c with the nodes in one array but linked in random
+ *               order, like a list built on a fragmented heap
+ *   unrolled  - a singly linked list of nodes holding UNROLL_CAP records
+ *   vector    - a contiguous array with an open-addressing hash index
+ * and reports, per layout:
+ *   insert - ns to append one record (push_back, or append and index)
+ *   find   - ns to look up one random key present in the layout; a linear
+ *            walk for the lists, an index probe for the vector
+ *   visit  - ns per record visited while walking to find a key; for the
+ *            vector, a linear scan of the array for comparison. This is
+ *            the column that exposes cache misses: it is flat while the
+ *            layout fits in cache and climbs once every step misses.
+ *   sort   - ns per record to sort by key; list_sort() for list.c, and
+ *            qsort() of the records for the others
+ *
+ * Finds are repeated until about VISITS records have been visited, so
+ * large sizes do fewer of them.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "list.h"
+
+/* Records per unrolled node, so that a node fills eight cache lines */
+#define UNROLL_CAP 31
+
+/* Default number of records visited by the finds of one measurement */
+#define DEFAULT_VISITS (1L << 25)
+
+typedef struct record {
+  uint64_t key;
+  uint64_t count;
+} record_t;
+
+struct item {
+  record_t rec;
+  struct list_elem elem;
+};
+
+typedef struct unode {
+  struct unode* next;
+  size_t len;
+  record_t recs[UNROLL_CAP];
+} unode_t;
+
+typedef struct unrolled {
+  unode_t* head;
+  unode_t* tail;
+} unrolled_t;
+
+typedef struct vector {
+  record_t* recs;
+  size_t len, cap;
+  uint32_t* index; /* Slot + 1 of each key, 0 when empty */
+  size_t index_mask;
+} vector_t;
+
+typedef struct result {
+  double insert, find, visit, sort;
+} result_t;
+
+/* Layout-independent inputs of one size */
+typedef struct workload {
+  size_t n;
+  uint64_t* keys;   /* Inserted in this order */
+  uint64_t* probes; /* Keys to find */
+  size_t nprobes;
+} workload_t;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t mix(uint64_t x) {
+  /* splitmix64 finalizer */
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static void* xmalloc(size_t size) {
+  void* p = malloc(size);
+  if (p == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  return p;
+}
+
+static int cmp_records(const void* a, const void* b) {
+  uint64_t x = ((const record_t*)a)->key, y = ((const record_t*)b)->key;
+  return x < y ? -1 : x > y;
+}
+
+static bool item_less(const struct list_elem* a, const struct list_elem* b, void* aux) {
+  return list_entry(a, struct item, elem)->rec.key < list_entry(b, struct item, elem)->rec.key;
+}
+
+/* Keeps the compiler from dropping lookups whose result is unused */
+static volatile uint64_t sink;
+
+/* list.c */
+
+static struct item* list_find(struct list* lst, uint64_t key, long* visited) {
+  struct list_elem* e;
+  for (e = list_begin(lst); e != list_end(lst); e = list_next(e)) {
+    struct item* it = list_entry(e, struct item, elem);
+    ++*visited;
+    if (it->rec.key == key)
+      return it;
+  }
+  return NULL;
+}
+
+/* Measure list.c with nodes from malloc, or from one array linked in random order. */
+static result_t bench_list(workload_t* w, bool shuffled, long* bad) {
+  result_t r;
+  struct list lst;
+  struct item* pool = NULL;
+  size_t* order = NULL;
+  list_init(&lst);
+
+  if (shuffled) {
+    pool = xmalloc(w->n * sizeof(struct item));
+    order = xmalloc(w->n * sizeof(size_t));
+    for (size_t i = 0; i < w->n; i++)
+      order[i] = i;
+    for (size_t i = w->n - 1; i > 0; i--) {
+      size_t j = mix(i) % (i + 1);
+      size_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+  }
+  double t0 = now();
+  for (size_t i = 0; i < w->n; i++) {
+    struct item* it = shuffled ? &pool[order[i]] : xmalloc(sizeof(struct item));
+    it->rec.key = w->keys[i];
+    it->rec.count = 1;
+    list_push_back(&lst, &it->elem);
+  }
+  r.insert = (now() - t0) / w->n;
+
+  long visited = 0;
+  t0 = now();
+  for (size_t i = 0; i < w->nprobes; i++) {
+    struct item* it = list_find(&lst, w->probes[i], &visited);
+    if (it == NULL)
+      ++*bad;
+    else
+      sink += it->rec.count;
+  }
+  double t = now() - t0;
+  r.find = t / w->nprobes;
+  r.visit = t / visited;
+
+  t0 = now();
+  list_sort(&lst, item_less, NULL);
+  r.sort = (now() - t0) / w->n;
+  uint64_t prev = 0;
+  while (!list_empty(&lst)) {
+    struct item* it = list_entry(list_pop_front(&lst), struct item, elem);
+    if (it->rec.key < prev)
+      ++*bad;
+    prev = it->rec.key;
+    if (!shuffled)
+      free(it);
+  }
+  free(pool);
+  free(order);
+  return r;
+}
+
+/* Unrolled list */
+
+static void unrolled_push_back(unrolled_t* u, uint64_t key) {
+  if (u->tail == NULL || u->tail->len == UNROLL_CAP) {
+    unode_t* node = xmalloc(sizeof(unode_t));
+    node->next = NULL;
+    node->len = 0;
+    if (u->tail == NULL)
+      u->head = node;
+    else
+      u->tail->next = node;
+    u->tail = node;
+  }
+  record_t* rec = &u->tail->recs[u->tail->len++];
+  rec->key = key;
+  rec->count = 1;
+}
+
+static record_t* unrolled_find(unrolled_t* u, uint64_t key, long* visited) {
+  for (unode_t* node = u->head; node != NULL; node = node->next) {
+    for (size_t i = 0; i < node->len; i++) {
+      if (node->recs[i].key == key) {
+        *visited += i + 1;
+        return &node->recs[i];
+      }
+    }
+    *visited += node->len;
+  }
+  return NULL;
+}
+
+static result_t bench_unrolled(workload_t* w, long* bad) {
+  result_t r;
+  unrolled_t u = {NULL, NULL};
+
+  double t0 = now();
+  for (size_t i = 0; i < w->n; i++)
+    unrolled_push_back(&u, w->keys[i]);
+  r.insert = (now() - t0) / w->n;
+
+  long visited = 0;
+  t0 = now();
+  for (size_t i = 0; i < w->nprobes; i++) {
+    record_t* rec = unrolled_find(&u, w->probes[i], &visited);
+    if (rec == NULL)
+      ++*bad;
+    else
+      sink += rec->count;
+  }
+  double t = now() - t0;
+  r.find = t / w->nprobes;
+  r.visit = t / visited;
+
+  /* Gather the records, sort them and write them back in place */
+  t0 = now();
+  record_t* tmp = xmalloc(w->n * sizeof(record_t));
+  size_t k = 0;
+  for (unode_t* node = u.head; node != NULL; node = node->next) {
+    memcpy(&tmp[k], node->recs, node->len * sizeof(record_t));
+    k += node->len;
+  }
+  qsort(tmp, k, sizeof(record_t), cmp_records);
+  k = 0;
+  for (unode_t* node = u.head; node != NULL; node = node->next) {
+    memcpy(node->recs, &tmp[k], node->len * sizeof(record_t));
+    k += node->len;
+  }
+  r.sort = (now() - t0) / w->n;
+  free(tmp);
+
+  uint64_t prev = 0;
+  while (u.head != NULL) {
+    unode_t* node = u.head;
+    for (size_t i = 0; i < node->len; i++) {
+      if (node->recs[i].key < prev)
+        ++*bad;
+      prev = node->recs[i].key;
+    }
+    u.head = node->next;
+    free(node);
+  }
+  return r;
+}
+
+/* Vector with a hash index */
+
+static void vector_index(vector_t* v, size_t slot) {
+  size_t h = mix(v->recs[slot].key) & v->index_mask;
+  while (v->index[h] != 0)
+    h = (h + 1) & v->index_mask;
+  v->index[h] = slot + 1;
+}
+
+static void vector_push_back(vector_t* v, uint64_t key) {
+  if (v->len == v->cap) {
+    v->cap = v->cap ? v->cap * 2 : 16;
+    v->recs = realloc(v->recs, v->cap * sizeof(record_t));
+    if (v->recs == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  /* Keep the index at most half full */
+  if (2 * (v->len + 1) > v->index_mask + 1) {
+    size_t size = v->index_mask ? 2 * (v->index_mask + 1) : 32;
+    free(v->index);
+    v->index = calloc(size, sizeof(uint32_t));
+    if (v->index == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    v->index_mask = size - 1;
+    for (size_t i = 0; i < v->len; i++)
+      vector_index(v, i);
+  }
+  v->recs[v->len].key = key;
+  v->recs[v->len].count = 1;
+  vector_index(v, v->len++);
+}
+
+static record_t* vector_find(vector_t* v, uint64_t key) {
+  size_t h = mix(key) & v->index_mask;
+  while (v->index[h] != 0) {
+    record_t* rec = &v->recs[v->index[h] - 1];
+    if (rec->key == key)
+      return rec;
+    h = (h + 1) & v->index_mask;
+  }
+  return NULL;
+}
+
+static result_t bench_vector(workload_t* w, long* bad) {
+  result_t r;
+  vector_t v = {NULL, 0, 0, NULL, 0};
+
+  double t0 = now();
+  for (size_t i = 0; i < w->n; i++)
+    vector_push_back(&v, w->keys[i]);
+  r.insert = (now() - t0) / w->n;
+
+  t0 = now();
+  for (size_t i = 0; i < w->nprobes; i++) {
+    record_t* rec = vector_find(&v, w->probes[i]);
+    if (rec == NULL)
+      ++*bad;
+    else
+      sink += rec->count;
+  }
+  r.find = (now() - t0) / w->nprobes;
+
+  /* The same walks as the lists, over the array */
+  long visited = 0;
+  t0 = now();
+  for (size_t i = 0; i < w->nprobes; i++) {
+    size_t j = 0;
+    while (j < v.len && v.recs[j].key != w->probes[i])
+      j++;
+    visited += j + 1;
+    sink += j;
+  }
+  r.visit = (now() - t0) / visited;
+
+  t0 = now();
+  qsort(v.recs, v.len, sizeof(record_t), cmp_records);
+  memset(v.index, 0, (v.index_mask + 1) * sizeof(uint32_t));
+  for (size_t i = 0; i < v.len; i++)
+    vector_index(&v, i);
+  r.sort = (now() - t0) / w->n;
+
+  for (size_t i = 1; i < v.len; i++)
+    if (v.recs[i].key < v.recs[i - 1].key)
+      ++*bad;
+  free(v.recs);
+  free(v.index);
+  return r;
+}
+
+static void report(size_t n, const char* name, result_t r) {
+  printf("%9zu %-9s %10.1f %12.1f %10.2f %10.1f\n", n, name, r.insert * 1e9, r.find * 1e9,
+         r.visit * 1e9, r.sort * 1e9);
+  fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+  size_t min_size = 1000;
+  size_t max_size = 10000000;
+  long visits = DEFAULT_VISITS;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:b:")) != -1) {
+    switch (opt) {
+      case 'm':
+        min_size = atol(optarg);
+        break;
+      case 'n':
+        max_size = atol(optarg);
+        break;
+      case 'b':
+        visits = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-m min_size] [-n max_size] [-b visits]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (min_size < 1 || max_size < min_size || visits < 1 || max_size >= UINT32_MAX) {
+    fprintf(stderr, "%s: invalid arguments\n", argv[0]);
+    return 1;
+  }
+
+  long bad = 0;
+  printf("%9s %-9s %10s %12s %10s %10s\n", "n", "layout", "insert ns", "find ns", "visit ns",
+         "sort ns");
+  for (size_t n = min_size; n <= max_size; n *= 10) {
+    workload_t w;
+    w.n = n;
+    w.keys = xmalloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < n; i++)
+      w.keys[i] = mix(i + 1);
+
+    /* A find walks past n/2 records on average */
+    w.nprobes = 2 * visits / n;
+    if (w.nprobes < 4)
+      w.nprobes = 4;
+    w.probes = xmalloc(w.nprobes * sizeof(uint64_t));
+    for (size_t i = 0; i < w.nprobes; i++)
+      w.probes[i] = w.keys[mix(i ^ n) % n];
+
+    report(n, "list", bench_list(&w, false, &bad));
+    report(n, "shuffled", bench_list(&w, true, &bad));
+    report(n, "unrolled", bench_unrolled(&w, &bad));
+    report(n, "vector", bench_vector(&w, &bad));
+    free(w.keys);
+    free(w.probes);
+    if (n > max_size / 10)
+      break;
+  }
+  if (bad != 0) {
+    printf("FAILED: %ld lookups or orderings were wrong\n", bad);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Implementation of the list_sort_parallel interface.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "list_sort_parallel.h"
+
+/* Runs this short are insertion sorted */
+#define INSERTION_SORT_MAX 16
+
+struct psort {
+  struct list* list;
+  list_less_func* less;
+  void* aux;
+  struct list_elem** buf[2]; /* Ping-pong element arrays */
+  size_t n;
+  int nthreads;
+  pthread_barrier_t barrier;
+};
+
+struct psort_thread {
+  struct psort* sort;
+  int id;
+  pthread_t tid;
+};
+
+/* Returns the start of part I when N elements are cut into P parts. */
+static inline size_t part_start(size_t n, int p, int i) { return n / p * i + (n % p) * i / p; }
+
+/* Stable merge sort of A[LO, HI) using B[LO, HI) as scratch; the result
+   ends up in A. */
+static void merge_sort(struct psort* s, struct list_elem** a, struct list_elem** b, size_t lo,
+                       size_t hi) {
+  if (hi - lo <= INSERTION_SORT_MAX) {
+    for (size_t i = lo + 1; i < hi; i++) {
+      struct list_elem* e = a[i];
+      size_t j = i;
+      while (j > lo && s->less(e, a[j - 1], s->aux)) {
+        a[j] = a[j - 1];
+        j--;
+      }
+      a[j] = e;
+    }
+    return;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  merge_sort(s, a, b, lo, mid);
+  merge_sort(s, a, b, mid, hi);
+  if (!s->less(a[mid], a[mid - 1], s->aux))
+    return;
+  memcpy(b + lo, a + lo, (hi - lo) * sizeof(*a));
+  size_t i = lo, j = mid, k = lo;
+  while (i < mid && j < hi)
+    a[k++] = s->less(b[j], b[i], s->aux) ? b[j++] : b[i++];
+  while (i < mid)
+    a[k++] = b[i++];
+  while (j < hi)
+    a[k++] = b[j++];
+}
+
+/*
+ * Returns how many elements of A[0, NA) are among the first K outputs of
+ * the stable merge of A and B[0, NB), in which A wins ties.
+ */
+static size_t co_rank(struct psort* s, struct list_elem** a, size_t na, struct list_elem** b,
+                      size_t nb, size_t k) {
+  size_t lo = k > nb ? k - nb : 0;
+  size_t hi = k < na ? k : na;
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    size_t j = k - i;
+    /* Too few from A if B[j-1] would not come before A[i] */
+    if (j > 0 && i < na && !s->less(b[j - 1], a[i], s->aux))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+/* Write outputs K0 through K1 (exclusive) of the stable merge of A and B to OUT. */
+static void merge_part(struct psort* s, struct list_elem** a, size_t na, struct list_elem** b,
+                       size_t nb, size_t k0, size_t k1, struct list_elem** out) {
+  size_t i = co_rank(s, a, na, b, nb, k0);
+  size_t j = k0 - i;
+  for (size_t k = k0; k < k1; k++) {
+    if (j < nb && (i == na || s->less(b[j], a[i], s->aux)))
+      out[k] = b[j++];
+    else
+      out[k] = a[i++];
+  }
+}
+
+static void* psort_thread(void* arg) {
+  struct psort_thread* t = arg;
+  struct psort* s = t->sort;
+  int p = s->nthreads;
+  size_t lo = part_start(s->n, p, t->id);
+  size_t hi = part_start(s->n, p, t->id + 1);
+  int cur = 0;
+
+  /* Sort this thread's run */
+  merge_sort(s, s->buf[0], s->buf[1], lo, hi);
+
+  /* Merge pairs of runs of STRIDE parts each until one run is left.
+     Each thread writes the same share of every level's output. */
+  for (int stride = 1; stride < p; stride *= 2) {
+    struct list_elem** src = s->buf[cur];
+    struct list_elem** dst = s->buf[!cur];
+    pthread_barrier_wait(&s->barrier);
+    for (int g = 0; g < p; g += 2 * stride) {
+      size_t g_lo = part_start(s->n, p, g);
+      size_t g_mid = part_start(s->n, p, g + stride < p ? g + stride : p);
+      size_t g_hi = part_start(s->n, p, g + 2 * stride < p ? g + 2 * stride : p);
+      size_t k0 = lo > g_lo ? lo : g_lo;
+      size_t k1 = hi < g_hi ? hi : g_hi;
+      if (k0 >= k1)
+        continue;
+      merge_part(s, src + g_lo, g_mid - g_lo, src + g_mid, g_hi - g_mid, k0 - g_lo, k1 - g_lo,
+                 dst + g_lo);
+    }
+    cur = !cur;
+  }
+  pthread_barrier_wait(&s->barrier);
+
+  /* Relink this thread's share of the sorted elements */
+  struct list_elem** sorted = s->buf[cur];
+  for (size_t i = lo; i < hi; i++) {
+    sorted[i]->prev = i > 0 ? sorted[i - 1] : list_head(s->list);
+    sorted[i]->next = i + 1 < s->n ? sorted[i + 1] : list_tail(s->list);
+  }
+  return NULL;
+}
+
+void list_sort_parallel(struct list* list, list_less_func* less, void* aux, int nthreads) {
+  ASSERT(list != NULL);
+  ASSERT(less != NULL);
+
+  size_t n = list_size(list);
+  if (n < LIST_SORT_PARALLEL_MIN) {
+    list_sort(list, less, aux);
+    return;
+  }
+  if (nthreads <= 0)
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if ((size_t)nthreads > n / LIST_SORT_PARALLEL_MIN)
+    nthreads = n / LIST_SORT_PARALLEL_MIN;
+  struct psort s;
+  s.buf[0] = malloc(n * sizeof(struct list_elem*));
+  s.buf[1] = malloc(n * sizeof(struct list_elem*));
+  if (s.buf[0] == NULL || s.buf[1] == NULL) {
+    free(s.buf[0]);
+    free(s.buf[1]);
+    list_sort(list, less, aux);
+    return;
+  }
+
+  s.list = list;
+  s.less = less;
+  s.aux = aux;
+  s.n = n;
+  s.nthreads = nthreads;
+  size_t i = 0;
+  struct list_elem* e;
+  for (e = list_begin(list); e != list_end(list); e = list_next(e))
+    s.buf[0][i++] = e;
+
+  struct psort_thread threads[nthreads];
+  pthread_barrier_init(&s.barrier, NULL, nthreads);
+  for (int t = 0; t < nthreads; t++) {
+    threads[t].sort = &s;
+    threads[t].id = t;
+    if (t > 0 && pthread_create(&threads[t].tid, NULL, psort_thread, &threads[t]) != 0)
+      PANIC("list_sort_parallel: pthread_create failed");
+  }
+  psort_thread(&threads[0]);
+  for (int t = 1; t < nthreads; t++)
+    pthread_join(threads[t].tid, NULL);
+  pthread_barrier_destroy(&s.barrier);
+
+  /* The threads linked every element; point the list's ends at them */
+  int cur = 0;
+  for (int stride = 1; stride < nthreads; stride *= 2)
+    cur = !cur;
+  list_head(list)->next = s.buf[cur][0];
+  list_tail(list)->prev = s.buf[cur][n - 1];
+  free(s.buf[0]);
+  free(s.buf[1]);
+}
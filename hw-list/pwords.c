@@ -1,5 +1,8 @@
 /*
- * Word count application with one thread per input file.
+ * Word count application with one thread per input file, or with a pool of
+ * workers counting word-aligned ranges of the input files (-s). Stdin is
+ * streamed to a pool of workers through a bounded ring of chunks. With -a
+ * or -m the counts are approximate heavy hitters kept in bounded memory.
  *
  * You may modify this file in any way you like, and are expected to modify it.
  * Your solution must read each input file from a separate thread. We encourage
@@ -28,58 +31,513 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "cmap.h"
 #include "word_count.h"
+#include "word_heap.h"
 #include "word_helpers.h"
+#include "word_scan.h"
+#include "word_stream.h"
+#include "word_summary.h"
+#include "word_table.h"
 
 /*
- * main - handle command line, spawning one thread per file.
+ * Word stores that the counting threads can share:
+ *   list  - the shared word_count_list_t, locked around every add_word()
+ *   local - a private word_table_t per thread, combined at the end by a
+ *           parallel merge tree and drained into the shared list
+ *   cmap  - one shared cmap with a lock per segment, drained into the
+ *           shared list at the end
+ *   approx - a private Space-Saving summary per thread, combined by the
+ *            same merge tree; counts are estimates with an error bound
  */
+typedef enum backend_t{
+  BACKEND_LIST,
+  BACKEND_LOCAL,
+  BACKEND_CMAP,
+  BACKEND_APPROX,
+}backend_t;
 
-typedef struct thread_args_t{
-  const char* filename;
+/* cmap segments per counting thread */
+#define CMAP_SEGMENTS_PER_THREAD 8
+
+/*
+ * Stdin is read by the main thread into a ring of STREAM_CHUNKS_PER_WORKER
+ * chunks per worker, which a pool of workers scans as they arrive.
+ */
+#define STREAM_CHUNKS_PER_WORKER 2
+
+/*
+ * Split mode - every file is mapped and cut into byte ranges that end on
+ * word boundaries. A fixed pool of workers pulls ranges off a shared queue.
+ */
+
+/* Ranges smaller than this are not worth handing to another worker */
+#define MIN_RANGE_SIZE (1 << 20)
+
+typedef struct range_t{
+  const char* buf;
+  size_t len;
+}range_t;
+
+typedef struct count_job_t{
+  backend_t backend;
   word_count_list_t* word_counts;
+  word_table_t* tables;
+  struct cmap map;
+  word_summary_t* summaries;
+  size_t summary_cap;
+  int nthreads;
+  pthread_barrier_t barrier;
+
+  /* One thread per file */
+  char** files;
+
+  /* Split mode */
+  range_t* ranges;
+  size_t nranges;
+  size_t next;
+  pthread_mutex_t lock;
+
+  /* Stdin */
+  word_stream_t stream;
+}count_job_t;
+
+typedef struct thread_args_t{
+  count_job_t* job;
+  int id;
 }thread_args_t;
 
+static void count_shared(const char* word, size_t len, void* aux){
+  char* copy=malloc(len+1);
+  memcpy(copy,word,len+1);
+  add_word((word_count_list_t*)aux,copy);
+}
+
+static void count_local(const char* word, size_t len, void* aux){
+  word_table_add((word_table_t*)aux,word,len,1);
+}
+
+static void count_approx(const char* word, size_t len, void* aux){
+  word_summary_add((word_summary_t*)aux,word,len);
+}
+
+static uint64_t word_elem_hash(const struct list_elem* e, void* aux){
+  const word_count_t* wc=list_entry(e,word_count_t,elem);
+  return word_hash(wc->word,strlen(wc->word));
+}
+
+static bool word_elem_equal(const struct list_elem* a, const struct list_elem* b, void* aux){
+  return strcmp(list_entry(a,word_count_t,elem)->word,list_entry(b,word_count_t,elem)->word)==0;
+}
+
+static struct list_elem* word_elem_create(const struct list_elem* key, void* aux){
+  word_count_t* wc=malloc(sizeof(word_count_t));
+  if(wc==NULL) return NULL;
+  wc->word=strdup(list_entry(key,word_count_t,elem)->word);
+  if(wc->word==NULL){
+    free(wc);
+    return NULL;
+  }
+  wc->count=0;
+  return &wc->elem;
+}
+
+static void word_elem_bump(struct list_elem* e, void* aux){
+  list_entry(e,word_count_t,elem)->count++;
+}
+
+static void word_elem_free(struct list_elem* e, void* aux){
+  word_count_t* wc=list_entry(e,word_count_t,elem);
+  free(wc->word);
+  free(wc);
+}
+
+static void count_cmap(const char* word, size_t len, void* aux){
+  word_count_t probe={.word=(char*)word};
+  if(cmap_upsert((struct cmap*)aux,&probe.elem,word_elem_create,word_elem_bump,NULL)==NULL){
+    perror("cmap_upsert fails");
+    exit(1);
+  }
+}
+
+/*
+ * Merge tree: at each level every table or summary whose index is a
+ * multiple of 2*stride absorbs its neighbour stride positions away, so all
+ * of them end up in index 0 after log2(nthreads) levels. Every thread must
+ * call this; it does nothing for the shared backends.
+ */
+static void merge_counts(count_job_t* job, int id){
+  if(job->backend!=BACKEND_LOCAL && job->backend!=BACKEND_APPROX) return;
+  for(int stride=1;stride<job->nthreads;stride*=2){
+    pthread_barrier_wait(&job->barrier);
+    if(id%(2*stride)==0 && id+stride<job->nthreads){
+      if(job->backend==BACKEND_LOCAL) word_table_merge(&job->tables[id],&job->tables[id+stride]);
+      else word_summary_merge(&job->summaries[id],&job->summaries[id+stride]);
+    }
+  }
+}
+
+/* Returns the word_scan_func that thread id counts with, and its argument in *aux. */
+static word_scan_func* counter_for(count_job_t* job, int id, void** aux){
+  if(job->backend==BACKEND_LOCAL){
+    *aux=&job->tables[id];
+    return count_local;
+  }
+  if(job->backend==BACKEND_CMAP){
+    *aux=&job->map;
+    return count_cmap;
+  }
+  if(job->backend==BACKEND_APPROX){
+    *aux=&job->summaries[id];
+    return count_approx;
+  }
+  *aux=job->word_counts;
+  return count_shared;
+}
+
 void* process_file(void* args){
   thread_args_t* params=(thread_args_t*) args;
-  FILE* infile=fopen(params->filename,"r");
+  count_job_t* job=params->job;
+  FILE* infile=fopen(job->files[params->id],"r");
   if(infile==NULL){
     perror("fopen fails");
-    return NULL;
   }
-  count_words(params->word_counts,infile);
-  fclose(infile);
+  else{
+    if(job->backend==BACKEND_LIST) count_words(job->word_counts,infile);
+    else{
+      void* aux;
+      word_scan_func* func=counter_for(job,params->id,&aux);
+      if(scan_stream(infile,func,aux)!=0) perror("fread fails");
+    }
+    fclose(infile);
+  }
+  merge_counts(job,params->id);
   return NULL;
 }
 
+static range_t* next_range(count_job_t* job){
+  range_t* r=NULL;
+  pthread_mutex_lock(&job->lock);
+  if(job->next<job->nranges) r=&job->ranges[job->next++];
+  pthread_mutex_unlock(&job->lock);
+  return r;
+}
+
+void* split_worker(void* args){
+  thread_args_t* params=(thread_args_t*)args;
+  count_job_t* job=params->job;
+  void* aux;
+  word_scan_func* func=counter_for(job,params->id,&aux);
+  range_t* r;
+  while((r=next_range(job))!=NULL) scan_words(r->buf,r->len,func,aux);
+  merge_counts(job,params->id);
+  return NULL;
+}
+
+void* stream_worker(void* args){
+  thread_args_t* params=(thread_args_t*)args;
+  count_job_t* job=params->job;
+  void* aux;
+  word_scan_func* func=counter_for(job,params->id,&aux);
+  chunk_t* c;
+  while((c=word_stream_take(&job->stream))!=NULL){
+    scan_words(c->buf,c->len,func,aux);
+    word_stream_release(&job->stream,c);
+  }
+  merge_counts(job,params->id);
+  return NULL;
+}
+
+/* Reader side of the stdin pipeline, run on the main thread. */
+static void feed_stdin(count_job_t* job){
+  if(word_stream_fill(&job->stream,stdin)!=0) perror("fread fails");
+}
+
+/* Append the ranges of buf[0..len) to job, growing job->ranges as needed. */
+static void add_ranges(count_job_t* job, size_t* cap, const char* buf, size_t len){
+  size_t chunk=len/(4*(size_t)job->nthreads)+1;
+  if(chunk<MIN_RANGE_SIZE) chunk=MIN_RANGE_SIZE;
+  size_t start=0;
+  while(start<len){
+    size_t end=word_boundary(buf,len,start+chunk);
+    if(job->nranges==*cap){
+      *cap=*cap?*cap*2:16;
+      job->ranges=realloc(job->ranges,*cap*sizeof(range_t));
+      if(job->ranges==NULL){
+        perror("realloc fails");
+        exit(1);
+      }
+    }
+    job->ranges[job->nranges].buf=buf+start;
+    job->ranges[job->nranges].len=end-start;
+    job->nranges++;
+    start=end;
+  }
+}
+
+/* Map each of the nfiles files and cut them into ranges. */
+static void map_files(count_job_t* job, int nfiles, void* maps[], size_t sizes[]){
+  size_t cap=0;
+  for(int f=0;f<nfiles;f++){
+    maps[f]=NULL;
+    sizes[f]=0;
+    int fd=open(job->files[f],O_RDONLY);
+    struct stat st;
+    if(fd<0 || fstat(fd,&st)<0){
+      perror("open fails");
+      if(fd>=0) close(fd);
+      continue;
+    }
+    if(st.st_size>0){
+      void* map=mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+      if(map==MAP_FAILED){
+        perror("mmap fails");
+      }
+      else{
+        maps[f]=map;
+        sizes[f]=st.st_size;
+        add_ranges(job,&cap,map,st.st_size);
+      }
+    }
+    close(fd);
+  }
+}
+
+/*
+ * Run job->nthreads copies of start, and feed on the main thread if it is
+ * not NULL, then collect their counts in job->word_counts, or leave them in
+ * job->summaries[0] for the approx backend.
+ */
+static void run_threads(count_job_t* job, void* (*start)(void*), void (*feed)(count_job_t*)){
+  int n=job->nthreads;
+  pthread_t threads[n];
+  thread_args_t thread_args[n];
+  if(job->backend==BACKEND_LOCAL){
+    job->tables=malloc(n*sizeof(word_table_t));
+    if(job->tables==NULL){
+      perror("malloc fails");
+      exit(1);
+    }
+    for(int t=0;t<n;t++) word_table_init(&job->tables[t]);
+  }
+  else if(job->backend==BACKEND_APPROX){
+    job->summaries=malloc(n*sizeof(word_summary_t));
+    if(job->summaries==NULL){
+      perror("malloc fails");
+      exit(1);
+    }
+    for(int t=0;t<n;t++){
+      if(!word_summary_init(&job->summaries[t],job->summary_cap)){
+        perror("malloc fails");
+        exit(1);
+      }
+    }
+  }
+  else if(job->backend==BACKEND_CMAP){
+    if(!cmap_init(&job->map,n*CMAP_SEGMENTS_PER_THREAD,word_elem_hash,word_elem_equal,NULL)){
+      perror("cmap_init fails");
+      exit(1);
+    }
+  }
+  pthread_barrier_init(&job->barrier,NULL,n);
+  for(int t=0;t<n;t++){
+    thread_args[t].job=job;
+    thread_args[t].id=t;
+    int rc=pthread_create(&threads[t],NULL,start,(void*)&thread_args[t]);
+    if(rc){
+      printf("ERROR; return code from pthread_create() is %d\n", rc);
+      exit(-1);
+    }
+  }
+  if(feed!=NULL) feed(job);
+  for(int t=0;t<n;t++) pthread_join(threads[t],NULL);
+  pthread_barrier_destroy(&job->barrier);
+  if(job->backend==BACKEND_LOCAL){
+    word_table_drain(&job->tables[0],job->word_counts);
+    for(int t=0;t<n;t++) word_table_destroy(&job->tables[t]);
+    free(job->tables);
+  }
+  else if(job->backend==BACKEND_CMAP){
+    pthread_mutex_lock(&job->word_counts->lock);
+    cmap_drain(&job->map,&job->word_counts->lst);
+    pthread_mutex_unlock(&job->word_counts->lock);
+    cmap_destroy(&job->map,word_elem_free);
+  }
+  else if(job->backend==BACKEND_APPROX){
+    for(int t=1;t<n;t++) word_summary_destroy(&job->summaries[t]);
+  }
+}
+
+/*
+ * Print the top entries of the approx backend's summary as count, word and
+ * the most the count may overstate the word's frequency by.
+ */
+static int print_summary(word_summary_t* summary, long top){
+  size_t k=top>=0?(size_t)top:summary->size;
+  summary_entry_t** entries=malloc(k*sizeof(summary_entry_t*)+1);
+  if(entries==NULL){
+    perror("malloc fails");
+    return 1;
+  }
+  k=word_summary_top(summary,k,entries);
+  fprintf(stderr,"approx: %ld words, %zu counters, error <= %ld\n",
+          summary->total,summary->cap,word_summary_bound(summary));
+  for(size_t i=0;i<k;i++)
+    printf("%ld\t%s\t%ld\n",entries[i]->count,entries[i]->word,entries[i]->error);
+  free(entries);
+  return 0;
+}
+
+static void usage(const char* prog){
+  fprintf(stderr,"usage: %s [-s] [-j workers] [-b list|local|cmap] [-a epsilon] [-m bytes]\n"
+                 "       [--top K] [file...]\n"
+                 "  -s  split files into ranges counted by a pool of workers\n"
+                 "  -j  number of workers in split and stdin mode (default: number of CPUs)\n"
+                 "  -b  word store: shared locked list, per-thread hash tables (default),\n"
+                 "      or a shared concurrent hash map\n"
+                 "  -a  count heavy hitters approximately, overcounting by at most epsilon\n"
+                 "      times the number of words; prints count, word and error bound\n"
+                 "  -m  count heavy hitters approximately in about this many bytes per worker\n"
+                 "  --top (-t) K  print only the K most frequent words\n",prog);
+}
+
+/*
+ * main - handle command line, spawning one thread per file, or a pool of
+ * workers for split mode and for stdin.
+ */
 int main(int argc, char* argv[]) {
+  bool split=false;
+  long nworkers=sysconf(_SC_NPROCESSORS_ONLN);
+  backend_t backend=BACKEND_LOCAL;
+  long top=-1;
+  double epsilon=0;
+  long memory=0;
+  static struct option long_options[]={
+    {"top",required_argument,0,'t'},
+    {0,0,0,0},
+  };
+  int opt;
+  while((opt=getopt_long(argc,argv,"sj:b:t:a:m:",long_options,NULL))!=-1){
+    switch(opt){
+      case 's':
+        split=true;
+        break;
+      case 'j':
+        nworkers=atol(optarg);
+        break;
+      case 't':
+        top=atol(optarg);
+        if(top<0){
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'a':
+        epsilon=atof(optarg);
+        if(epsilon<=0 || epsilon>=1){
+          usage(argv[0]);
+          return 1;
+        }
+        backend=BACKEND_APPROX;
+        break;
+      case 'm':
+        memory=atol(optarg);
+        if(memory<=0){
+          usage(argv[0]);
+          return 1;
+        }
+        backend=BACKEND_APPROX;
+        break;
+      case 'b':
+        if(strcmp(optarg,"list")==0) backend=BACKEND_LIST;
+        else if(strcmp(optarg,"local")==0) backend=BACKEND_LOCAL;
+        else if(strcmp(optarg,"cmap")==0) backend=BACKEND_CMAP;
+        else{
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if(nworkers<1) nworkers=1;
+  int nfiles=argc-optind;
+
   /* Create the empty data structure. */
   word_count_list_t word_counts;
   init_words(&word_counts);
 
-  if (argc <= 1) {
-    /* Process stdin in a single thread. */
-    count_words(&word_counts, stdin);
-  } else {
-    /* TODO */
-    int rc;
-    pthread_t threads[argc-1];
-    thread_args_t thread_args[argc-1];
-    for (size_t t = 1; t < argc; t++) {
-      thread_args[t-1].filename=argv[t];
-      thread_args[t-1].word_counts=&word_counts;
-      rc = pthread_create(&threads[t-1], NULL, process_file, (void*)&thread_args[t-1]);
-      if (rc) {
-        printf("ERROR; return code from pthread_create() is %d\n", rc);
-        exit(-1);
-      }
+  count_job_t job;
+  memset(&job,0,sizeof(job));
+  job.backend=backend;
+  job.word_counts=&word_counts;
+  job.files=argv+optind;
+  job.summary_cap=word_summary_capacity(epsilon,memory);
+  pthread_mutex_init(&job.lock,NULL);
+
+  if (nfiles < 1) {
+    /* Stream stdin through a bounded ring of chunks to a pool of workers. */
+    job.nthreads=nworkers;
+    if(word_stream_init(&job.stream,nworkers*STREAM_CHUNKS_PER_WORKER,STREAM_CHUNK_SIZE)!=0){
+      perror("malloc fails");
+      return 1;
     }
-    for(size_t t=0;t<argc-1;t++) pthread_join(threads[t],NULL);
+    run_threads(&job,stream_worker,feed_stdin);
+    word_stream_destroy(&job.stream);
+  } else if (split) {
+    void* maps[nfiles];
+    size_t sizes[nfiles];
+    job.nthreads=nworkers;
+    map_files(&job,nfiles,maps,sizes);
+    run_threads(&job,split_worker,NULL);
+    for(int f=0;f<nfiles;f++) if(maps[f]!=NULL) munmap(maps[f],sizes[f]);
+    free(job.ranges);
+  } else {
+    job.nthreads=nfiles;
+    run_threads(&job,process_file,NULL);
   }
+  pthread_mutex_destroy(&job.lock);
 
   /* Output final result of all threads' work. */
-  wordcount_sort(&word_counts, less_count);
-  fprint_words(&word_counts, stdout);
+  if(backend==BACKEND_APPROX){
+    int rc=print_summary(&job.summaries[0],top);
+    word_summary_destroy(&job.summaries[0]);
+    free(job.summaries);
+    return rc;
+  }
+  if(top>=0){
+    word_heap_t heap;
+    if((size_t)top>len_words(&word_counts)) top=len_words(&word_counts);
+    if(!word_heap_init(&heap,top,less_count)){
+      perror("malloc fails");
+      return 1;
+    }
+    struct list_elem* e;
+    for(e=list_begin(&word_counts.lst);e!=list_end(&word_counts.lst);e=list_next(e))
+      word_heap_offer(&heap,list_entry(e,word_count_t,elem));
+    size_t n=word_heap_drain(&heap,heap.items);
+
+    /* Move the winners to their own list and print it with fprint_words() */
+    word_count_list_t top_counts;
+    init_words(&top_counts);
+    for(size_t i=0;i<n;i++){
+      list_remove(&heap.items[i]->elem);
+      list_push_back(&top_counts.lst,&heap.items[i]->elem);
+    }
+    fprint_words(&top_counts,stdout);
+    word_heap_destroy(&heap);
+  }
+  else{
+    wordcount_sort(&word_counts, less_count);
+    fprint_words(&word_counts, stdout);
+  }
   return 0;
 }
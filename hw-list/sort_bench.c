@@ -0,0 +1,137 @@
+/*
+ * Check and benchmark list_sort_parallel() against list_sort().
+ *
+ * Usage: sort_bench [-n elements] [-t max_threads] [-k keys]
+ *
+ * Builds two identical lists of elements whose keys repeat (about
+ * elements / keys copies of each), sorts one with list_sort() and the
+ * other with list_sort_parallel() on 1, 2, 4, ... and max_threads threads,
+ * and checks that both leave the elements in exactly the same order, so
+ * equal keys must keep their original order. Reports the time of each.
+ */
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "list_sort_parallel.h"
+
+struct item {
+  uint64_t key;
+  size_t seq; /* Position in the unsorted list */
+  struct list_elem elem;
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t mix(uint64_t x) {
+  /* splitmix64 finalizer */
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static bool item_less(const struct list_elem* a, const struct list_elem* b, void* aux) {
+  return list_entry(a, struct item, elem)->key < list_entry(b, struct item, elem)->key;
+}
+
+/* Fill LST with N items, linked in a random order of memory. */
+static struct item* build(struct list* lst, size_t n, uint64_t nkeys) {
+  struct item* items = malloc(n * sizeof(struct item));
+  size_t* order = malloc(n * sizeof(size_t));
+  if (items == NULL || order == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (size_t i = 0; i < n; i++)
+    order[i] = i;
+  for (size_t i = n - 1; i > 0; i--) {
+    size_t j = mix(i) % (i + 1);
+    size_t t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  list_init(lst);
+  for (size_t i = 0; i < n; i++) {
+    struct item* it = &items[order[i]];
+    it->key = mix(i * 7919 + 1) % nkeys;
+    it->seq = i;
+    list_push_back(lst, &it->elem);
+  }
+  free(order);
+  return items;
+}
+
+int main(int argc, char* argv[]) {
+  size_t n = 4000000;
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t nkeys = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:k:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atol(optarg);
+        break;
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'k':
+        nkeys = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n elements] [-t max_threads] [-k keys]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (nkeys == 0)
+    nkeys = n / 8 + 1;
+  if (n < 1 || max_threads < 1) {
+    fprintf(stderr, "%s: invalid arguments\n", argv[0]);
+    return 1;
+  }
+
+  struct list expect;
+  struct item* expect_items = build(&expect, n, nkeys);
+  double t0 = now();
+  list_sort(&expect, item_less, NULL);
+  double base = now() - t0;
+  printf("%zu elements, %lu keys\n", n, (unsigned long)nkeys);
+  printf("%8s %12s %10s\n", "threads", "ms", "speedup");
+  printf("%8s %12.1f %10.2f\n", "list", base * 1e3, 1.0);
+
+  int failed = 0;
+  /* Doubling thread counts, ending with max_threads itself */
+  for (int t = 1; t <= max_threads;
+       t = t < max_threads && 2 * t > max_threads ? max_threads : 2 * t) {
+    struct list lst;
+    struct item* items = build(&lst, n, nkeys);
+    t0 = now();
+    list_sort_parallel(&lst, item_less, NULL, t);
+    double elapsed = now() - t0;
+
+    struct list_elem *a, *b;
+    size_t count = 0;
+    for (a = list_begin(&expect), b = list_begin(&lst);
+         a != list_end(&expect) && b != list_end(&lst); a = list_next(a), b = list_next(b)) {
+      if (list_entry(a, struct item, elem)->seq != list_entry(b, struct item, elem)->seq)
+        break;
+      count++;
+    }
+    bool same = count == n && a == list_end(&expect) && b == list_end(&lst) &&
+                list_prev(list_end(&lst)) == list_back(&lst);
+    printf("%8d %12.1f %10.2f%s\n", t, elapsed * 1e3, base / elapsed, same ? "" : "  MISMATCH");
+    failed |= !same;
+    free(items);
+  }
+  free(expect_items);
+  return failed;
+}
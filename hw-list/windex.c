@@ -0,0 +1,418 @@
+/*
+ * windex - count a corpus once into a persistent index, then answer
+ * queries from the memory-mapped index without re-reading the text.
+ *
+ * Usage:
+ *   windex build [-p] INDEX FILE...
+ *   windex query [-v] INDEX count WORD...
+ *   windex query [-v] INDEX prefix PREFIX
+ *   windex query [-v] INDEX top K
+ *   windex query [-v] INDEX files WORD
+ *
+ * build counts the words of the files into INDEX; -p also records which
+ * files each word occurs in. When INDEX already exists with postings,
+ * only files whose size or modification time changed are read again; the
+ * counts of the others come from the old index.
+ *
+ * query prints counts in the same "count<TAB>word" form as pwords: the
+ * given words, every word starting with PREFIX in alphabetical order, the
+ * K most frequent words in the order pwords --top K prints them, or the
+ * files a word occurs in. -v reports the time taken on stderr.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "word_count.h"
+#include "word_helpers.h"
+#include "word_index.h"
+#include "word_scan.h"
+#include "word_table.h"
+
+static void usage(void) {
+  fprintf(stderr, "usage: windex build [-p] INDEX FILE...\n"
+                  "       windex query [-v] INDEX count WORD...\n"
+                  "       windex query [-v] INDEX prefix PREFIX\n"
+                  "       windex query [-v] INDEX top K\n"
+                  "       windex query [-v] INDEX files WORD\n");
+}
+
+static double now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Building */
+
+static void count_local(const char* word, size_t len, void* aux) {
+  word_table_add((word_table_t*)aux, word, len, 1);
+}
+
+/* Count the words of PATH into WORDS, sorted alphabetically. */
+static int count_file(const char* path, word_count_list_t* words) {
+  FILE* infile = fopen(path, "r");
+  if (infile == NULL)
+    return -1;
+  word_table_t table;
+  word_table_init(&table);
+  int rc = scan_stream(infile, count_local, &table);
+  fclose(infile);
+  word_table_drain(&table, words);
+  word_table_destroy(&table);
+  wordcount_sort(words, less_word);
+  return rc;
+}
+
+/*
+ * Rebuild the sorted word lists of the files that did not change from the
+ * postings of OLD. REMAP gives the new position of each old file, or -1.
+ */
+static void load_unchanged(word_index_t* old, const int* remap, word_count_list_t* words) {
+  index_cursor_t cursor;
+  index_posting_t* postings = malloc((old->hdr->nfiles + 1) * sizeof(index_posting_t));
+  if (postings == NULL || !index_cursor_init(&cursor, old)) {
+    perror("malloc fails");
+    exit(1);
+  }
+  if (index_cursor_seek_id(&cursor, 0)) {
+    do {
+      size_t n = index_cursor_postings(&cursor, postings);
+      for (size_t i = 0; i < n; i++) {
+        int f = remap[postings[i].file];
+        if (f < 0)
+          continue;
+        word_count_t* wc = malloc(sizeof(word_count_t));
+        if (wc == NULL || (wc->word = strdup(cursor.word)) == NULL) {
+          perror("malloc fails");
+          exit(1);
+        }
+        wc->count = postings[i].count;
+        list_push_back(&words[f].lst, &wc->elem);
+      }
+    } while (index_cursor_next(&cursor));
+  }
+  index_cursor_destroy(&cursor);
+  free(postings);
+}
+
+static inline word_count_t* head(word_count_list_t* words) {
+  return list_entry(list_front(&words->lst), word_count_t, elem);
+}
+
+/* Orders files by their next word, then by position. */
+static bool source_less(word_count_list_t* words, uint32_t a, uint32_t b) {
+  int cmp = strcmp(head(&words[a])->word, head(&words[b])->word);
+  return cmp < 0 || (cmp == 0 && a < b);
+}
+
+static void sift_down(word_count_list_t* words, uint32_t* heap, size_t size, size_t i) {
+  uint32_t f = heap[i];
+  for (;;) {
+    size_t least = 2 * i + 1;
+    if (least >= size)
+      break;
+    if (least + 1 < size && source_less(words, heap[least + 1], heap[least]))
+      least++;
+    if (!source_less(words, heap[least], f))
+      break;
+    heap[i] = heap[least];
+    i = least;
+  }
+  heap[i] = f;
+}
+
+/* Merge the sorted word lists of NFILES files into WRITER, emptying them. */
+static void merge_files(word_count_list_t* words, uint32_t nfiles, index_writer_t* writer) {
+  uint32_t* heap = malloc((nfiles + 1) * sizeof(uint32_t));
+  index_posting_t* postings = malloc((nfiles + 1) * sizeof(index_posting_t));
+  char* word = NULL;
+  size_t cap = 0;
+  if (heap == NULL || postings == NULL) {
+    perror("malloc fails");
+    exit(1);
+  }
+  size_t size = 0;
+  for (uint32_t f = 0; f < nfiles; f++)
+    if (!list_empty(&words[f].lst))
+      heap[size++] = f;
+  for (size_t i = size / 2; i > 0; i--)
+    sift_down(words, heap, size, i - 1);
+
+  while (size > 0) {
+    size_t len = strlen(head(&words[heap[0]])->word);
+    if (len + 1 > cap) {
+      cap = 2 * (len + 1);
+      word = realloc(word, cap);
+      if (word == NULL) {
+        perror("malloc fails");
+        exit(1);
+      }
+    }
+    memcpy(word, head(&words[heap[0]])->word, len + 1);
+
+    /* Pop the word off every file it starts, in file order */
+    long total = 0;
+    size_t n = 0;
+    while (size > 0 && strcmp(head(&words[heap[0]])->word, word) == 0) {
+      uint32_t f = heap[0];
+      word_count_t* wc = list_entry(list_pop_front(&words[f].lst), word_count_t, elem);
+      postings[n].file = f;
+      postings[n].count = wc->count;
+      total += wc->count;
+      n++;
+      free(wc->word);
+      free(wc);
+      if (list_empty(&words[f].lst))
+        heap[0] = heap[--size];
+      if (size > 0)
+        sift_down(words, heap, size, 0);
+    }
+    index_writer_add(writer, word, total, postings, n);
+  }
+  free(word);
+  free(postings);
+  free(heap);
+}
+
+static int build(int argc, char* argv[]) {
+  bool with_postings = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "p")) != -1) {
+    if (opt != 'p') {
+      usage();
+      return 1;
+    }
+    with_postings = true;
+  }
+  if (argc - optind < 2) {
+    usage();
+    return 1;
+  }
+  const char* path = argv[optind];
+  char** paths = argv + optind + 1;
+  uint32_t nfiles = argc - optind - 1;
+
+  index_file_t* files = malloc(nfiles * sizeof(index_file_t));
+  word_count_list_t* words = malloc(nfiles * sizeof(word_count_list_t));
+  if (files == NULL || words == NULL) {
+    perror("malloc fails");
+    return 1;
+  }
+  for (uint32_t f = 0; f < nfiles; f++) {
+    struct stat st;
+    if (stat(paths[f], &st) < 0) {
+      perror(paths[f]);
+      return 1;
+    }
+    files[f].path = paths[f];
+    files[f].size = st.st_size;
+    files[f].mtime_sec = st.st_mtim.tv_sec;
+    files[f].mtime_nsec = st.st_mtim.tv_nsec;
+    init_words(&words[f]);
+  }
+
+  /* Take the counts of unchanged files from the old index, if it has them */
+  bool* fresh = calloc(nfiles + 1, sizeof(bool));
+  word_index_t old;
+  bool have_old = false;
+  if (fresh == NULL) {
+    perror("malloc fails");
+    return 1;
+  }
+  if (word_index_open(&old, path) == 0) {
+    have_old = true;
+    if (old.hdr->flags & INDEX_POSTINGS) {
+      int* remap = malloc((old.hdr->nfiles + 1) * sizeof(int));
+      if (remap == NULL) {
+        perror("malloc fails");
+        return 1;
+      }
+      for (uint32_t o = 0; o < old.hdr->nfiles; o++) {
+        remap[o] = -1;
+        for (uint32_t f = 0; f < nfiles; f++) {
+          if (!fresh[f] && strcmp(old.files[o].path, files[f].path) == 0 &&
+              old.files[o].size == files[f].size &&
+              old.files[o].mtime_sec == files[f].mtime_sec &&
+              old.files[o].mtime_nsec == files[f].mtime_nsec) {
+            remap[o] = f;
+            fresh[f] = true;
+            break;
+          }
+        }
+      }
+      load_unchanged(&old, remap, words);
+      free(remap);
+    }
+  } else if (errno != ENOENT) {
+    perror(path);
+  }
+
+  uint32_t rescanned = 0;
+  for (uint32_t f = 0; f < nfiles; f++) {
+    if (fresh[f])
+      continue;
+    if (count_file(paths[f], &words[f]) != 0) {
+      perror(paths[f]);
+      return 1;
+    }
+    rescanned++;
+  }
+
+  index_writer_t writer;
+  index_writer_init(&writer, with_postings);
+  merge_files(words, nfiles, &writer);
+  int rc = index_writer_write(&writer, path, files, nfiles);
+  if (rc != 0)
+    perror(path);
+  else
+    fprintf(stderr, "windex: %lu words (%lu distinct) from %u files, %u read\n",
+            (unsigned long)writer.total, (unsigned long)writer.nwords, nfiles, rescanned);
+  index_writer_destroy(&writer);
+  if (have_old)
+    word_index_close(&old);
+  free(fresh);
+  free(words);
+  free(files);
+  return rc == 0 ? 0 : 1;
+}
+
+/* Querying */
+
+/* Lowercase S in place, matching the words in the index. */
+static char* lowercase(char* s) {
+  for (char* p = s; *p; p++)
+    *p = tolower((unsigned char)*p);
+  return s;
+}
+
+static int query_count(index_cursor_t* cursor, int nwords, char* words[]) {
+  for (int i = 0; i < nwords; i++) {
+    char* word = lowercase(words[i]);
+    bool found = index_cursor_seek(cursor, word) && strcmp(cursor->word, word) == 0;
+    printf("%ld\t%s\n", found ? cursor->count : 0, word);
+  }
+  return 0;
+}
+
+static int query_prefix(index_cursor_t* cursor, char* prefix) {
+  size_t len = strlen(lowercase(prefix));
+  if (!index_cursor_seek(cursor, prefix))
+    return 0;
+  do {
+    if (strncmp(cursor->word, prefix, len) != 0)
+      break;
+    printf("%ld\t%s\n", cursor->count, cursor->word);
+  } while (index_cursor_next(cursor));
+  return 0;
+}
+
+static int query_top(index_cursor_t* cursor, long k) {
+  const word_index_t* index = cursor->index;
+  if (k < 0) {
+    usage();
+    return 1;
+  }
+  if ((uint64_t)k > index->hdr->nwords)
+    k = index->hdr->nwords;
+  for (long i = k - 1; i >= 0; i--) {
+    index_cursor_seek_id(cursor, index->rank[i]);
+    printf("%ld\t%s\n", cursor->count, cursor->word);
+  }
+  return 0;
+}
+
+static int query_files(index_cursor_t* cursor, char* word) {
+  const word_index_t* index = cursor->index;
+  if (!(index->hdr->flags & INDEX_POSTINGS)) {
+    fprintf(stderr, "windex: index has no postings; build it with -p\n");
+    return 1;
+  }
+  lowercase(word);
+  if (!index_cursor_seek(cursor, word) || strcmp(cursor->word, word) != 0)
+    return 0;
+  index_posting_t* postings = malloc((index->hdr->nfiles + 1) * sizeof(index_posting_t));
+  if (postings == NULL) {
+    perror("malloc fails");
+    return 1;
+  }
+  size_t n = index_cursor_postings(cursor, postings);
+  for (size_t i = 0; i < n; i++)
+    printf("%ld\t%s\n", postings[i].count, index->files[postings[i].file].path);
+  free(postings);
+  return 0;
+}
+
+static int query(int argc, char* argv[]) {
+  bool verbose = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "v")) != -1) {
+    if (opt != 'v') {
+      usage();
+      return 1;
+    }
+    verbose = true;
+  }
+  if (argc - optind < 3) {
+    usage();
+    return 1;
+  }
+  const char* path = argv[optind];
+  const char* what = argv[optind + 1];
+  char** args = argv + optind + 2;
+  int nargs = argc - optind - 2;
+
+  double start = now_us();
+  word_index_t index;
+  index_cursor_t cursor;
+  if (word_index_open(&index, path) != 0) {
+    perror(path);
+    return 1;
+  }
+  if (!index_cursor_init(&cursor, &index)) {
+    perror("malloc fails");
+    return 1;
+  }
+  double opened = now_us();
+
+  int rc;
+  if (strcmp(what, "count") == 0)
+    rc = query_count(&cursor, nargs, args);
+  else if (strcmp(what, "prefix") == 0 && nargs == 1)
+    rc = query_prefix(&cursor, args[0]);
+  else if (strcmp(what, "top") == 0 && nargs == 1)
+    rc = query_top(&cursor, atol(args[0]));
+  else if (strcmp(what, "files") == 0 && nargs == 1)
+    rc = query_files(&cursor, args[0]);
+  else {
+    usage();
+    rc = 1;
+  }
+  fflush(stdout);
+  if (verbose)
+    fprintf(stderr, "windex: opened in %.1f us, answered in %.1f us\n", opened - start,
+            now_us() - opened);
+
+  index_cursor_destroy(&cursor);
+  word_index_close(&index);
+  return rc;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+  if (strcmp(argv[1], "build") == 0)
+    return build(argc - 1, argv + 1);
+  if (strcmp(argv[1], "query") == 0)
+    return query(argc - 1, argv + 1);
+  usage();
+  return 1;
+}
@@ -29,6 +29,7 @@
 #endif
 
 #include "word_count.h"
+#include "list_sort_parallel.h"
 
 void init_words(word_count_list_t* wclist) { /* TODO */
   list_init(&wclist->lst);
@@ -65,6 +66,7 @@ word_count_t* add_word(word_count_list_t* wclist, char* word) {
   else{
     found->count++;
     ret=found;
+    free(word);
   }
   pthread_mutex_unlock(&wclist->lock);
   return ret;
@@ -89,5 +91,5 @@ static bool less_list(const struct list_elem* ewc1, const struct list_elem* ewc2
 void wordcount_sort(word_count_list_t* wclist,
                     bool less(const word_count_t*, const word_count_t*)) {
   /* TODO */
-  list_sort(&wclist->lst, less_list, less);
+  list_sort_parallel(&wclist->lst, less_list, less, 0);
 }
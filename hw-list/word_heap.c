@@ -0,0 +1,84 @@
+/*
+ * Implementation of the word_heap interface.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "word_heap.h"
+
+static inline void swap(word_count_t** a, word_count_t** b) {
+  word_count_t* t = *a;
+  *a = *b;
+  *b = t;
+}
+
+static void sift_up(word_heap_t* heap, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (!heap->less(heap->items[i], heap->items[parent]))
+      break;
+    swap(&heap->items[i], &heap->items[parent]);
+    i = parent;
+  }
+}
+
+static void sift_down(word_heap_t* heap, size_t i) {
+  for (;;) {
+    size_t least = i;
+    size_t left = 2 * i + 1;
+    size_t right = left + 1;
+    if (left < heap->size && heap->less(heap->items[left], heap->items[least]))
+      least = left;
+    if (right < heap->size && heap->less(heap->items[right], heap->items[least]))
+      least = right;
+    if (least == i)
+      return;
+    swap(&heap->items[i], &heap->items[least]);
+    i = least;
+  }
+}
+
+bool word_heap_init(word_heap_t* heap, size_t k,
+                    bool less(const word_count_t*, const word_count_t*)) {
+  heap->items = k > 0 ? malloc(k * sizeof(word_count_t*)) : NULL;
+  if (k > 0 && heap->items == NULL)
+    return false;
+  heap->size = 0;
+  heap->cap = k;
+  heap->less = less;
+  return true;
+}
+
+void word_heap_offer(word_heap_t* heap, word_count_t* wc) {
+  if (heap->size < heap->cap) {
+    heap->items[heap->size] = wc;
+    sift_up(heap, heap->size++);
+  } else if (heap->cap > 0 && heap->less(heap->items[0], wc)) {
+    heap->items[0] = wc;
+    sift_down(heap, 0);
+  }
+}
+
+size_t word_heap_drain(word_heap_t* heap, word_count_t** out) {
+  /* Heap-sort in place: each popped minimum goes to the slot the heap
+     just gave up, which leaves the items in descending order */
+  size_t n = heap->size;
+  while (heap->size > 0) {
+    word_count_t* least = heap->items[0];
+    heap->items[0] = heap->items[--heap->size];
+    sift_down(heap, 0);
+    heap->items[heap->size] = least;
+  }
+  for (size_t i = 0; i < n / 2; i++)
+    swap(&heap->items[i], &heap->items[n - 1 - i]);
+  if (out != heap->items)
+    memcpy(out, heap->items, n * sizeof(word_count_t*));
+  return n;
+}
+
+void word_heap_destroy(word_heap_t* heap) {
+  free(heap->items);
+  heap->items = NULL;
+  heap->size = heap->cap = 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * The word_heap interface selects the K greatest entries of a word count
+ * list without sorting it, using a bounded min-heap of K pointers: O(n log K)
+ * time and O(K) extra memory.
+ *
+ * Entries are only referenced, never copied, so the list they came from
+ * must outlive the heap.
+ */
+
+#ifndef WORD_HEAP_H
+#define WORD_HEAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "word_count.h"
+
+typedef struct word_heap {
+  word_count_t** items; /* items[0] is the least of the K kept so far */
+  size_t size;
+  size_t cap; /* K */
+  bool (*less)(const word_count_t*, const word_count_t*);
+} word_heap_t;
+
+/* Initialize a heap that keeps the K greatest entries according to LESS. */
+bool word_heap_init(word_heap_t* heap, size_t k, bool less(const word_count_t*, const word_count_t*));
+
+/* Offer WC to the heap, which keeps it if it is among the K greatest so far. */
+void word_heap_offer(word_heap_t* heap, word_count_t* wc);
+
+/*
+ * Empty the heap into OUT in ascending order, returning the number of
+ * entries. OUT may be heap->items itself.
+ */
+size_t word_heap_drain(word_heap_t* heap, word_count_t** out);
+
+/* Free the heap's storage. */
+void word_heap_destroy(word_heap_t* heap);
+
+#endif /* WORD_HEAP_H */
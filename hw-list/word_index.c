@@ -0,0 +1,390 @@
+/*
+ * Implementation of the word_index interface.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "word_index.h"
+
+/* Bytes in the fixed part of a file record: size, mtime and path length */
+#define FILE_RECORD_SIZE (3 * sizeof(int64_t) + sizeof(uint32_t))
+
+static inline size_t align8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static const uint8_t* get_varint(const uint8_t* p, uint64_t* value) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (*p & 0x80) {
+    v |= (uint64_t)(*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  *value = v | (uint64_t)*p++ << shift;
+  return p;
+}
+
+/* Grow *BUF to hold at least NEED bytes. */
+static void reserve(uint8_t** buf, size_t* cap, size_t need) {
+  if (need <= *cap)
+    return;
+  while (*cap < need)
+    *cap = *cap ? *cap * 2 : 4096;
+  *buf = realloc(*buf, *cap);
+  if (*buf == NULL)
+    PANIC("word_index: out of memory");
+}
+
+static void put_varint(uint8_t** buf, size_t* len, size_t* cap, uint64_t v) {
+  reserve(buf, cap, *len + 10);
+  while (v >= 0x80) {
+    (*buf)[(*len)++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  (*buf)[(*len)++] = (uint8_t)v;
+}
+
+static void put_bytes(uint8_t** buf, size_t* len, size_t* cap, const void* bytes, size_t n) {
+  reserve(buf, cap, *len + n);
+  memcpy(*buf + *len, bytes, n);
+  *len += n;
+}
+
+/* Reader */
+
+/* Returns true if the header's sections lie inside a file of LEN bytes, in order. */
+static bool header_valid(const index_header_t* hdr, size_t len) {
+  return hdr->magic == INDEX_MAGIC && hdr->version == INDEX_VERSION && hdr->size == len &&
+         hdr->files_off >= sizeof(index_header_t) && hdr->files_off <= hdr->blocks_off &&
+         hdr->blocks_off + hdr->nblocks * sizeof(uint64_t) <= hdr->strings_off &&
+         hdr->strings_off <= hdr->postings_off && hdr->postings_off <= hdr->rank_off &&
+         hdr->rank_off + hdr->nwords * sizeof(uint32_t) <= len &&
+         hdr->nblocks == (hdr->nwords + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+}
+
+/* Parse the file records of INDEX. Returns false if they are malformed. */
+static bool read_files(word_index_t* index) {
+  const index_header_t* hdr = index->hdr;
+  size_t off = hdr->files_off;
+  index->files = calloc(hdr->nfiles + 1, sizeof(index_file_t));
+  if (index->files == NULL)
+    return false;
+  for (uint32_t f = 0; f < hdr->nfiles; f++) {
+    uint32_t path_len;
+    if (off + FILE_RECORD_SIZE > hdr->blocks_off)
+      return false;
+    memcpy(&index->files[f].size, index->map + off, sizeof(int64_t));
+    memcpy(&index->files[f].mtime_sec, index->map + off + 8, sizeof(int64_t));
+    memcpy(&index->files[f].mtime_nsec, index->map + off + 16, sizeof(int64_t));
+    memcpy(&path_len, index->map + off + 24, sizeof(uint32_t));
+    off += FILE_RECORD_SIZE;
+    if (off + path_len + 1 > hdr->blocks_off || index->map[off + path_len] != '\0')
+      return false;
+    index->files[f].path = (char*)index->map + off;
+    off = align8(off + path_len + 1);
+  }
+  return true;
+}
+
+int word_index_open(word_index_t* index, const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(index_header_t)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+
+  index->map = map;
+  index->len = st.st_size;
+  index->hdr = map;
+  index->files = NULL;
+  if (!header_valid(index->hdr, index->len) || !read_files(index)) {
+    word_index_close(index);
+    errno = EINVAL;
+    return -1;
+  }
+  index->blocks = (const uint64_t*)(index->map + index->hdr->blocks_off);
+  index->strings = index->map + index->hdr->strings_off;
+  index->postings = index->map + index->hdr->postings_off;
+  index->rank = (const uint32_t*)(index->map + index->hdr->rank_off);
+  return 0;
+}
+
+void word_index_close(word_index_t* index) {
+  free(index->files);
+  munmap((void*)index->map, index->len);
+  index->map = NULL;
+  index->files = NULL;
+}
+
+bool index_cursor_init(index_cursor_t* cursor, const word_index_t* index) {
+  cursor->index = index;
+  cursor->word = malloc(index->hdr->max_word_len + 1);
+  if (cursor->word == NULL)
+    return false;
+  cursor->word[0] = '\0';
+  cursor->len = 0;
+  return true;
+}
+
+/* Decode the entry at P, which follows the cursor's current word. */
+static void decode(index_cursor_t* cursor, const uint8_t* p) {
+  uint64_t shared, unshared, count, off;
+  p = get_varint(p, &shared);
+  p = get_varint(p, &unshared);
+  memcpy(cursor->word + shared, p, unshared);
+  p += unshared;
+  cursor->len = shared + unshared;
+  cursor->word[cursor->len] = '\0';
+  p = get_varint(p, &count);
+  cursor->count = count;
+  cursor->postings = NULL;
+  if (cursor->index->hdr->flags & INDEX_POSTINGS) {
+    p = get_varint(p, &off);
+    cursor->postings = cursor->index->postings + off;
+  }
+  cursor->next = p;
+}
+
+/* Position CURSOR at the first word of block B. */
+static void seek_block(index_cursor_t* cursor, uint64_t b) {
+  cursor->id = b * INDEX_BLOCK_SIZE;
+  decode(cursor, cursor->index->strings + cursor->index->blocks[b]);
+}
+
+bool index_cursor_seek_id(index_cursor_t* cursor, uint64_t id) {
+  if (id >= cursor->index->hdr->nwords)
+    return false;
+  seek_block(cursor, id / INDEX_BLOCK_SIZE);
+  while (cursor->id < id)
+    index_cursor_next(cursor);
+  return true;
+}
+
+bool index_cursor_seek(index_cursor_t* cursor, const char* key) {
+  const word_index_t* index = cursor->index;
+  if (index->hdr->nwords == 0)
+    return false;
+
+  /* Find the last block whose first word is not greater than KEY */
+  uint64_t lo = 0, hi = index->hdr->nblocks;
+  while (hi - lo > 1) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    seek_block(cursor, mid);
+    if (strcmp(cursor->word, key) <= 0)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  seek_block(cursor, lo);
+  while (strcmp(cursor->word, key) < 0)
+    if (!index_cursor_next(cursor))
+      return false;
+  return true;
+}
+
+bool index_cursor_next(index_cursor_t* cursor) {
+  if (cursor->id + 1 >= cursor->index->hdr->nwords)
+    return false;
+  cursor->id++;
+  decode(cursor, cursor->next);
+  return true;
+}
+
+size_t index_cursor_postings(const index_cursor_t* cursor, index_posting_t* out) {
+  if (cursor->postings == NULL)
+    return 0;
+  uint64_t n, delta, count, file = 0;
+  const uint8_t* p = get_varint(cursor->postings, &n);
+  for (uint64_t i = 0; i < n; i++) {
+    p = get_varint(p, &delta);
+    p = get_varint(p, &count);
+    file += delta;
+    out[i].file = file;
+    out[i].count = count;
+  }
+  return n;
+}
+
+void index_cursor_destroy(index_cursor_t* cursor) {
+  free(cursor->word);
+  cursor->word = NULL;
+}
+
+/* Writer */
+
+void index_writer_init(index_writer_t* writer, bool with_postings) {
+  memset(writer, 0, sizeof(*writer));
+  writer->with_postings = with_postings;
+}
+
+void index_writer_add(index_writer_t* writer, const char* word, long count,
+                      const index_posting_t* postings, size_t n) {
+  size_t len = strlen(word);
+  size_t shared = 0;
+
+  if (writer->nwords == writer->cap) {
+    writer->cap = writer->cap ? writer->cap * 2 : 1024;
+    writer->counts = realloc(writer->counts, writer->cap * sizeof(long));
+    writer->blocks = realloc(writer->blocks,
+                             (writer->cap / INDEX_BLOCK_SIZE + 1) * sizeof(uint64_t));
+    if (writer->counts == NULL || writer->blocks == NULL)
+      PANIC("word_index: out of memory");
+  }
+  if (writer->nwords % INDEX_BLOCK_SIZE == 0) {
+    writer->blocks[writer->nblocks++] = writer->strings_len;
+  } else {
+    while (shared < len && shared < writer->prev_len && word[shared] == writer->prev[shared])
+      shared++;
+  }
+
+  put_varint(&writer->strings, &writer->strings_len, &writer->strings_cap, shared);
+  put_varint(&writer->strings, &writer->strings_len, &writer->strings_cap, len - shared);
+  put_bytes(&writer->strings, &writer->strings_len, &writer->strings_cap, word + shared,
+            len - shared);
+  put_varint(&writer->strings, &writer->strings_len, &writer->strings_cap, count);
+  if (writer->with_postings) {
+    put_varint(&writer->strings, &writer->strings_len, &writer->strings_cap,
+               writer->postings_len);
+    put_varint(&writer->postings, &writer->postings_len, &writer->postings_cap, n);
+    uint32_t file = 0;
+    for (size_t i = 0; i < n; i++) {
+      put_varint(&writer->postings, &writer->postings_len, &writer->postings_cap,
+                 postings[i].file - file);
+      put_varint(&writer->postings, &writer->postings_len, &writer->postings_cap,
+                 postings[i].count);
+      file = postings[i].file;
+    }
+  }
+
+  reserve((uint8_t**)&writer->prev, &writer->prev_cap, len + 1);
+  memcpy(writer->prev, word, len + 1);
+  writer->prev_len = len;
+  if (len > writer->max_word_len)
+    writer->max_word_len = len;
+  writer->counts[writer->nwords++] = count;
+  writer->total += count;
+}
+
+typedef struct rank_entry {
+  long count;
+  uint32_t id;
+} rank_entry_t;
+
+/* Most frequent first; ties in reverse word order, so the rank reads as
+   less_count() order backwards. */
+static int cmp_rank(const void* a, const void* b) {
+  const rank_entry_t* x = a;
+  const rank_entry_t* y = b;
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return x->id < y->id ? 1 : -1;
+}
+
+static bool write_padding(FILE* out, size_t n) {
+  static const char zeros[8];
+  return fwrite(zeros, 1, n, out) == n;
+}
+
+int index_writer_write(index_writer_t* writer, const char* path, const index_file_t* files,
+                       uint32_t nfiles) {
+  index_header_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = INDEX_MAGIC;
+  hdr.version = INDEX_VERSION;
+  hdr.flags = writer->with_postings ? INDEX_POSTINGS : 0;
+  hdr.nfiles = nfiles;
+  hdr.nwords = writer->nwords;
+  hdr.total = writer->total;
+  hdr.max_word_len = writer->max_word_len;
+  hdr.nblocks = writer->nblocks;
+  hdr.files_off = align8(sizeof(hdr));
+  size_t off = hdr.files_off;
+  for (uint32_t f = 0; f < nfiles; f++)
+    off = align8(off + FILE_RECORD_SIZE + strlen(files[f].path) + 1);
+  hdr.blocks_off = off;
+  hdr.strings_off = hdr.blocks_off + hdr.nblocks * sizeof(uint64_t);
+  hdr.postings_off = hdr.strings_off + writer->strings_len;
+  hdr.rank_off = align8(hdr.postings_off + writer->postings_len);
+  hdr.size = hdr.rank_off + hdr.nwords * sizeof(uint32_t);
+
+  rank_entry_t* rank = malloc(writer->nwords * sizeof(rank_entry_t) + 1);
+  uint32_t* ids = malloc(writer->nwords * sizeof(uint32_t) + 1);
+  if (rank == NULL || ids == NULL)
+    PANIC("word_index: out of memory");
+  for (uint64_t i = 0; i < writer->nwords; i++) {
+    rank[i].count = writer->counts[i];
+    rank[i].id = i;
+  }
+  qsort(rank, writer->nwords, sizeof(rank_entry_t), cmp_rank);
+  for (uint64_t i = 0; i < writer->nwords; i++)
+    ids[i] = rank[i].id;
+  free(rank);
+
+  /* Write a temporary file next to PATH and rename it into place */
+  size_t path_len = strlen(path);
+  char* tmp = malloc(path_len + sizeof(".tmp"));
+  if (tmp == NULL)
+    PANIC("word_index: out of memory");
+  memcpy(tmp, path, path_len);
+  memcpy(tmp + path_len, ".tmp", sizeof(".tmp"));
+  FILE* out = fopen(tmp, "wb");
+  if (out == NULL) {
+    free(tmp);
+    free(ids);
+    return -1;
+  }
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+            write_padding(out, hdr.files_off - sizeof(hdr));
+  off = hdr.files_off;
+  for (uint32_t f = 0; ok && f < nfiles; f++) {
+    uint32_t len = strlen(files[f].path);
+    size_t end = align8(off + FILE_RECORD_SIZE + len + 1);
+    ok = fwrite(&files[f].size, sizeof(int64_t), 1, out) == 1 &&
+         fwrite(&files[f].mtime_sec, sizeof(int64_t), 1, out) == 1 &&
+         fwrite(&files[f].mtime_nsec, sizeof(int64_t), 1, out) == 1 &&
+         fwrite(&len, sizeof(len), 1, out) == 1 && fwrite(files[f].path, 1, len + 1, out) == len + 1 &&
+         write_padding(out, end - (off + FILE_RECORD_SIZE + len + 1));
+    off = end;
+  }
+  ok = ok && fwrite(writer->blocks, sizeof(uint64_t), hdr.nblocks, out) == hdr.nblocks &&
+       fwrite(writer->strings, 1, writer->strings_len, out) == writer->strings_len &&
+       fwrite(writer->postings, 1, writer->postings_len, out) == writer->postings_len &&
+       write_padding(out, hdr.rank_off - (hdr.postings_off + writer->postings_len)) &&
+       fwrite(ids, sizeof(uint32_t), hdr.nwords, out) == hdr.nwords;
+  if (fclose(out) != 0)
+    ok = false;
+  if (ok && rename(tmp, path) != 0)
+    ok = false;
+  if (!ok)
+    unlink(tmp);
+  free(tmp);
+  free(ids);
+  return ok ? 0 : -1;
+}
+
+void index_writer_destroy(index_writer_t* writer) {
+  free(writer->strings);
+  free(writer->postings);
+  free(writer->blocks);
+  free(writer->counts);
+  free(writer->prev);
+  memset(writer, 0, sizeof(*writer));
+}
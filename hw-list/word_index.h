@@ -0,0 +1,160 @@
+/*
+ * The word_index interface reads and writes a persistent index of word
+ * counts, so that a corpus counted once can be queried again without
+ * re-reading its text.
+ *
+ * An index file holds, after a fixed header:
+ *   files    - path, size and modification time of every indexed file
+ *   blocks   - the offset of every block of the string table
+ *   strings  - the sorted string table, one entry per distinct word
+ *   postings - optionally, the files each word occurs in and how often
+ *   rank     - word ids ordered from the most to the least frequent
+ *
+ * The string table is prefix-compressed in blocks of INDEX_BLOCK_SIZE
+ * entries. Each entry stores the length of the prefix it shares with the
+ * previous word, the remaining bytes, its count and the offset of its
+ * postings; the first entry of a block shares nothing, so a lookup binary
+ * searches the blocks and decodes at most one of them. Integers inside
+ * entries and postings are LEB128 varints.
+ *
+ * Readers mmap the file and never copy it.
+ */
+
+#ifndef WORD_INDEX_H
+#define WORD_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INDEX_MAGIC 0x58444957 /* "WIDX" */
+#define INDEX_VERSION 1
+
+/* Words per string table block */
+#define INDEX_BLOCK_SIZE 16
+
+/* Header flags */
+#define INDEX_POSTINGS 0x1
+
+typedef struct index_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t flags;
+  uint32_t nfiles;
+  uint64_t nwords; /* Distinct words */
+  uint64_t total;  /* Sum of all counts */
+  uint64_t max_word_len;
+  uint64_t nblocks;
+  uint64_t files_off; /* Section offsets from the start of the file */
+  uint64_t blocks_off;
+  uint64_t strings_off;
+  uint64_t postings_off;
+  uint64_t rank_off;
+  uint64_t size; /* Of the whole file */
+} index_header_t;
+
+/* An indexed file, recorded so that unchanged files can be skipped later. */
+typedef struct index_file {
+  char* path;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} index_file_t;
+
+typedef struct index_posting {
+  uint32_t file; /* Position in the index's file list */
+  long count;
+} index_posting_t;
+
+typedef struct word_index {
+  const uint8_t* map;
+  size_t len;
+  const index_header_t* hdr;
+  const uint64_t* blocks;
+  const uint8_t* strings;
+  const uint8_t* postings;
+  const uint32_t* rank;
+  index_file_t* files;
+} word_index_t;
+
+/* A position in the string table. */
+typedef struct index_cursor {
+  const word_index_t* index;
+  uint64_t id;         /* Ordinal of the current word */
+  const uint8_t* next; /* Encoding of the word after it */
+  char* word;          /* The current word, NUL-terminated */
+  size_t len;
+  long count;
+  const uint8_t* postings; /* Its postings, or NULL */
+} index_cursor_t;
+
+/*
+ * Map the index at PATH. Returns 0 on success, or -1 with errno set; a file
+ * that is not a well-formed index fails with EINVAL.
+ */
+int word_index_open(word_index_t* index, const char* path);
+
+/* Unmap INDEX. */
+void word_index_close(word_index_t* index);
+
+/* Prepare CURSOR for INDEX. Returns false if out of memory. */
+bool index_cursor_init(index_cursor_t* cursor, const word_index_t* index);
+
+/* Position CURSOR at word ID. Returns false if there is no such word. */
+bool index_cursor_seek_id(index_cursor_t* cursor, uint64_t id);
+
+/*
+ * Position CURSOR at the first word not less than KEY. Returns false if
+ * every word is less than KEY.
+ */
+bool index_cursor_seek(index_cursor_t* cursor, const char* key);
+
+/* Advance CURSOR to the next word. Returns false after the last word. */
+bool index_cursor_next(index_cursor_t* cursor);
+
+/*
+ * Store the postings of the current word in OUT, which must have room for
+ * one per indexed file. Returns the number stored; 0 without postings.
+ */
+size_t index_cursor_postings(const index_cursor_t* cursor, index_posting_t* out);
+
+/* Free CURSOR's storage. */
+void index_cursor_destroy(index_cursor_t* cursor);
+
+/* Builds an index from words added in strictly ascending order. */
+typedef struct index_writer {
+  bool with_postings;
+  uint8_t* strings;
+  size_t strings_len, strings_cap;
+  uint8_t* postings;
+  size_t postings_len, postings_cap;
+  uint64_t* blocks;
+  long* counts; /* Of every word so far, for the rank section */
+  uint64_t nwords, nblocks, cap;
+  uint64_t total;
+  char* prev; /* The previous word */
+  size_t prev_len, prev_cap;
+  uint64_t max_word_len;
+} index_writer_t;
+
+/* Start an empty index, recording postings if WITH_POSTINGS. */
+void index_writer_init(index_writer_t* writer, bool with_postings);
+
+/*
+ * Append WORD with its total COUNT and, if the writer records postings,
+ * its N postings in ascending file order.
+ */
+void index_writer_add(index_writer_t* writer, const char* word, long count,
+                      const index_posting_t* postings, size_t n);
+
+/*
+ * Write the index to PATH, replacing any existing file atomically, with
+ * the NFILES FILES it was built from. Returns 0 on success, -1 on error.
+ */
+int index_writer_write(index_writer_t* writer, const char* path, const index_file_t* files,
+                       uint32_t nfiles);
+
+/* Free the writer's storage. */
+void index_writer_destroy(index_writer_t* writer);
+
+#endif /* WORD_INDEX_H */
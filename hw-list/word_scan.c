@@ -0,0 +1,98 @@
+/*
+ * Implementation of the word_scan interface.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "word_scan.h"
+
+uint64_t word_hash(const char* word, size_t len) {
+  /* 64-bit FNV-1a */
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)word[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+size_t word_boundary(const char* buf, size_t len, size_t off) {
+  if (off >= len)
+    return len;
+  /* Inside a word only if both neighbours of the cut are word bytes */
+  while (off > 0 && off < len && is_word_char(buf[off - 1]) && is_word_char(buf[off]))
+    off++;
+  return off;
+}
+
+void scan_words(const char* buf, size_t len, word_scan_func* func, void* aux) {
+  size_t cap = 64;
+  char* word = malloc(cap);
+  if (word == NULL)
+    PANIC("scan_words: out of memory");
+
+  size_t pos = 0;
+  while (pos < len) {
+    while (pos < len && !is_word_char(buf[pos]))
+      pos++;
+    size_t start = pos;
+    while (pos < len && is_word_char(buf[pos]))
+      pos++;
+
+    size_t n = pos - start;
+    if (n < 2)
+      continue;
+    if (n >= cap) {
+      while (n >= cap)
+        cap *= 2;
+      free(word);
+      word = malloc(cap);
+      if (word == NULL)
+        PANIC("scan_words: out of memory");
+    }
+    for (size_t i = 0; i < n; i++)
+      word[i] = buf[start + i] | 0x20;
+    word[n] = '\0';
+    func(word, n, aux);
+  }
+  free(word);
+}
+
+int scan_stream(FILE* infile, word_scan_func* func, void* aux) {
+  size_t cap = SCAN_BLOCK_SIZE;
+  char* buf = malloc(cap);
+  if (buf == NULL)
+    PANIC("scan_stream: out of memory");
+
+  size_t have = 0;
+  for (;;) {
+    size_t got = fread(buf + have, 1, cap - have, infile);
+    size_t len = have + got;
+    if (got == 0) {
+      if (ferror(infile)) {
+        free(buf);
+        return -1;
+      }
+      scan_words(buf, len, func, aux);
+      break;
+    }
+
+    /* Hold back a trailing word that may continue in the next block */
+    size_t end = len;
+    while (end > 0 && is_word_char(buf[end - 1]))
+      end--;
+    if (end == 0 && len == cap) {
+      cap *= 2;
+      buf = realloc(buf, cap);
+      if (buf == NULL)
+        PANIC("scan_stream: out of memory");
+    }
+    scan_words(buf, end, func, aux);
+    memmove(buf, buf + end, len - end);
+    have = len - end;
+  }
+  free(buf);
+  return 0;
+}
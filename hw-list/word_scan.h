@@ -0,0 +1,47 @@
+/*
+ * The word_scan interface extracts words from in-memory byte ranges, so
+ * that a file can be cut into pieces and counted by several threads.
+ *
+ * A word is a run of two or more alphabetic characters, lowercased, which
+ * matches the words produced by count_words().
+ */
+
+#ifndef WORD_SCAN_H
+#define WORD_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Bytes read from a stream at a time by scan_stream() */
+#define SCAN_BLOCK_SIZE (1 << 16)
+
+/*
+ * Called once for each word found. WORD is a NUL-terminated, lowercased
+ * copy of LEN bytes that is only valid for the duration of the call.
+ */
+typedef void word_scan_func(const char* word, size_t len, void* aux);
+
+/* Returns true if C is part of a word. */
+static inline bool is_word_char(unsigned char c) { return (unsigned char)((c | 0x20) - 'a') < 26; }
+
+/* Returns the hash of the LEN bytes at WORD. */
+uint64_t word_hash(const char* word, size_t len);
+
+/*
+ * Returns the first offset at or after OFF in BUF[0..LEN) that does not
+ * fall inside a word, so that ranges split there never cut a word in two.
+ */
+size_t word_boundary(const char* buf, size_t len, size_t off);
+
+/* Calls FUNC with AUX for every word in BUF[0..LEN). */
+void scan_words(const char* buf, size_t len, word_scan_func* func, void* aux);
+
+/*
+ * Calls FUNC with AUX for every word read from INFILE, which is consumed in
+ * blocks of SCAN_BLOCK_SIZE bytes. Returns 0 on success, -1 on a read error.
+ */
+int scan_stream(FILE* infile, word_scan_func* func, void* aux);
+
+#endif /* WORD_SCAN_H */
@@ -0,0 +1,155 @@
+/*
+ * Implementation of the word_stream interface.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "word_scan.h"
+#include "word_stream.h"
+
+static void queue_push(word_stream_t* stream, chunk_queue_t* q, chunk_t* chunk) {
+  q->slots[(q->head + q->count) % stream->nchunks] = chunk - stream->chunks;
+  q->count++;
+}
+
+static chunk_t* queue_pop(word_stream_t* stream, chunk_queue_t* q) {
+  chunk_t* chunk = &stream->chunks[q->slots[q->head]];
+  q->head = (q->head + 1) % stream->nchunks;
+  q->count--;
+  return chunk;
+}
+
+int word_stream_init(word_stream_t* stream, size_t nchunks, size_t chunk_size) {
+  stream->chunks = calloc(nchunks, sizeof(chunk_t));
+  stream->free.slots = malloc(nchunks * sizeof(size_t));
+  stream->full.slots = malloc(nchunks * sizeof(size_t));
+  if (stream->chunks == NULL || stream->free.slots == NULL || stream->full.slots == NULL)
+    goto fail;
+  stream->nchunks = nchunks;
+  stream->free.head = stream->free.count = 0;
+  stream->full.head = stream->full.count = 0;
+  for (size_t i = 0; i < nchunks; i++) {
+    stream->chunks[i].buf = malloc(chunk_size);
+    if (stream->chunks[i].buf == NULL)
+      goto fail;
+    stream->chunks[i].cap = chunk_size;
+    queue_push(stream, &stream->free, &stream->chunks[i]);
+  }
+  stream->eof = false;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->has_free, NULL);
+  pthread_cond_init(&stream->has_full, NULL);
+  return 0;
+
+fail:
+  /* The chunks were zeroed, so the buffers not yet allocated are NULL */
+  if (stream->chunks != NULL)
+    for (size_t i = 0; i < nchunks; i++)
+      free(stream->chunks[i].buf);
+  free(stream->chunks);
+  free(stream->free.slots);
+  free(stream->full.slots);
+  return -1;
+}
+
+/* Wait for a chunk the reader may fill. */
+static chunk_t* take_free(word_stream_t* stream) {
+  pthread_mutex_lock(&stream->lock);
+  while (stream->free.count == 0)
+    pthread_cond_wait(&stream->has_free, &stream->lock);
+  chunk_t* chunk = queue_pop(stream, &stream->free);
+  pthread_mutex_unlock(&stream->lock);
+  return chunk;
+}
+
+/* Queue a filled chunk for the workers. */
+static void put_full(word_stream_t* stream, chunk_t* chunk) {
+  pthread_mutex_lock(&stream->lock);
+  queue_push(stream, &stream->full, chunk);
+  pthread_cond_signal(&stream->has_full);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+int word_stream_fill(word_stream_t* stream, FILE* infile) {
+  char* carry = NULL;
+  size_t carry_len = 0;
+  size_t carry_cap = 0;
+  int rc = 0;
+
+  for (;;) {
+    chunk_t* chunk = take_free(stream);
+
+    /* A word longer than the chunk leaves no room to read, so grow it */
+    if (carry_len >= chunk->cap) {
+      chunk->cap = carry_len * 2;
+      chunk->buf = realloc(chunk->buf, chunk->cap);
+      if (chunk->buf == NULL)
+        PANIC("word_stream_fill: out of memory");
+    }
+    if (carry_len > 0)
+      memcpy(chunk->buf, carry, carry_len);
+    size_t got = fread(chunk->buf + carry_len, 1, chunk->cap - carry_len, infile);
+    size_t len = carry_len + got;
+
+    if (got == 0) {
+      if (ferror(infile))
+        rc = -1;
+      chunk->len = len;
+      put_full(stream, chunk);
+      break;
+    }
+
+    /* Hold back a trailing word that may continue in the next read */
+    size_t end = len;
+    while (end > 0 && is_word_char(chunk->buf[end - 1]))
+      end--;
+    carry_len = len - end;
+    if (carry_len > carry_cap) {
+      carry_cap = carry_len * 2;
+      carry = realloc(carry, carry_cap);
+      if (carry == NULL)
+        PANIC("word_stream_fill: out of memory");
+    }
+    memcpy(carry, chunk->buf + end, carry_len);
+    chunk->len = end;
+    put_full(stream, chunk);
+  }
+  free(carry);
+
+  pthread_mutex_lock(&stream->lock);
+  stream->eof = true;
+  pthread_cond_broadcast(&stream->has_full);
+  pthread_mutex_unlock(&stream->lock);
+  return rc;
+}
+
+chunk_t* word_stream_take(word_stream_t* stream) {
+  chunk_t* chunk = NULL;
+  pthread_mutex_lock(&stream->lock);
+  while (stream->full.count == 0 && !stream->eof)
+    pthread_cond_wait(&stream->has_full, &stream->lock);
+  if (stream->full.count > 0)
+    chunk = queue_pop(stream, &stream->full);
+  pthread_mutex_unlock(&stream->lock);
+  return chunk;
+}
+
+void word_stream_release(word_stream_t* stream, chunk_t* chunk) {
+  pthread_mutex_lock(&stream->lock);
+  queue_push(stream, &stream->free, chunk);
+  pthread_cond_signal(&stream->has_free);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+void word_stream_destroy(word_stream_t* stream) {
+  for (size_t i = 0; i < stream->nchunks; i++)
+    free(stream->chunks[i].buf);
+  free(stream->chunks);
+  free(stream->free.slots);
+  free(stream->full.slots);
+  pthread_cond_destroy(&stream->has_full);
+  pthread_cond_destroy(&stream->has_free);
+  pthread_mutex_destroy(&stream->lock);
+}
@@ -0,0 +1,66 @@
+/*
+ * The word_stream interface hands an unbounded input stream to a pool of
+ * tokenizer threads through a fixed ring of chunk buffers.
+ *
+ * One reader thread fills free chunks from the stream, cutting each one at
+ * the last word boundary and carrying the partial word over to the next
+ * chunk, and queues them as full. Workers take full chunks, scan them, and
+ * give them back. The reader blocks while every chunk is in use, so memory
+ * stays at nchunks * chunk_size however long the input is.
+ */
+
+#ifndef WORD_STREAM_H
+#define WORD_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Bytes per chunk */
+#define STREAM_CHUNK_SIZE (1 << 20)
+
+typedef struct chunk {
+  char* buf;
+  size_t len; /* Bytes of complete words in buf */
+  size_t cap;
+} chunk_t;
+
+/* A bounded FIFO of chunk indices. */
+typedef struct chunk_queue {
+  size_t* slots;
+  size_t head;
+  size_t count;
+} chunk_queue_t;
+
+typedef struct word_stream {
+  chunk_t* chunks;
+  size_t nchunks;
+  chunk_queue_t free; /* Chunks the reader may fill */
+  chunk_queue_t full; /* Chunks waiting for a worker */
+  bool eof;           /* The reader has queued its last chunk */
+  pthread_mutex_t lock;
+  pthread_cond_t has_free;
+  pthread_cond_t has_full;
+} word_stream_t;
+
+/* Initialize a stream with NCHUNKS chunks of CHUNK_SIZE bytes. Returns 0 on success. */
+int word_stream_init(word_stream_t* stream, size_t nchunks, size_t chunk_size);
+
+/*
+ * Reader side: read INFILE to the end, queueing chunks for the workers,
+ * then mark the stream finished. Returns 0 on success, -1 on a read error;
+ * the stream is finished either way.
+ */
+int word_stream_fill(word_stream_t* stream, FILE* infile);
+
+/* Worker side: wait for a full chunk. Returns NULL once the stream is drained. */
+chunk_t* word_stream_take(word_stream_t* stream);
+
+/* Worker side: give a chunk returned by word_stream_take() back to the reader. */
+void word_stream_release(word_stream_t* stream, chunk_t* chunk);
+
+/* Free the chunks of a stream no thread is using any more. */
+void word_stream_destroy(word_stream_t* stream);
+
+#endif /* WORD_STREAM_H */
@@ -0,0 +1,264 @@
+/*
+ * Implementation of the word_summary interface: Space-Saving with a lazily
+ * maintained min-heap of counters and a chained hash index over Pintos
+ * lists.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "word_scan.h"
+#include "word_summary.h"
+
+/* Counters used when neither an error bound nor a memory cap is given */
+#define SUMMARY_DEFAULT_CAP 10000
+
+/* Rough bytes per counter, assuming words of about 16 bytes */
+#define SUMMARY_ENTRY_COST                                                                         \
+  (sizeof(summary_entry_t) + sizeof(summary_entry_t*) + sizeof(struct list) + 16)
+
+size_t word_summary_capacity(double epsilon, size_t memory) {
+  size_t cap = 0;
+  if (epsilon > 0)
+    cap = (size_t)(1 / epsilon) + 1;
+  if (memory > 0 && (cap == 0 || memory / SUMMARY_ENTRY_COST < cap))
+    cap = memory / SUMMARY_ENTRY_COST;
+  if (epsilon <= 0 && memory == 0)
+    cap = SUMMARY_DEFAULT_CAP;
+  return cap > 0 ? cap : 1;
+}
+
+static inline void heap_set(word_summary_t* summary, size_t i, summary_entry_t* e) {
+  summary->heap[i] = e;
+  e->heap_index = i;
+}
+
+static void sift_up(word_summary_t* summary, size_t i) {
+  summary_entry_t* e = summary->heap[i];
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (summary->heap[parent]->key <= e->key)
+      break;
+    heap_set(summary, i, summary->heap[parent]);
+    i = parent;
+  }
+  heap_set(summary, i, e);
+}
+
+static void sift_down(word_summary_t* summary, size_t i) {
+  summary_entry_t* e = summary->heap[i];
+  for (;;) {
+    size_t least = 2 * i + 1;
+    if (least >= summary->size)
+      break;
+    if (least + 1 < summary->size && summary->heap[least + 1]->key < summary->heap[least]->key)
+      least++;
+    if (e->key <= summary->heap[least]->key)
+      break;
+    heap_set(summary, i, summary->heap[least]);
+    i = least;
+  }
+  heap_set(summary, i, e);
+}
+
+/*
+ * Returns an entry with the smallest count. Every key is at most its
+ * entry's count, so once the top of the heap is fresh no other entry can
+ * have a smaller count.
+ */
+static summary_entry_t* settle_min(word_summary_t* summary) {
+  for (;;) {
+    summary_entry_t* e = summary->heap[0];
+    if (e->key == e->count)
+      return e;
+    e->key = e->count;
+    sift_down(summary, 0);
+  }
+}
+
+static inline struct list* bucket_of(word_summary_t* summary, uint64_t hash) {
+  return &summary->buckets[hash & (summary->nbuckets - 1)];
+}
+
+static summary_entry_t* find_entry(word_summary_t* summary, const char* word, size_t len,
+                                   uint64_t hash) {
+  struct list* bucket = bucket_of(summary, hash);
+  struct list_elem* e;
+  for (e = list_begin(bucket); e != list_end(bucket); e = list_next(e)) {
+    summary_entry_t* se = list_entry(e, summary_entry_t, elem);
+    if (se->hash == hash && strncmp(se->word, word, len) == 0 && se->word[len] == '\0')
+      return se;
+  }
+  return NULL;
+}
+
+/* Give E a copy of the LEN-byte WORD, reusing its buffer when possible. */
+static void set_word(summary_entry_t* e, const char* word, size_t len, uint64_t hash) {
+  if (e->word == NULL || strlen(e->word) < len) {
+    free(e->word);
+    e->word = malloc(len + 1);
+    if (e->word == NULL)
+      PANIC("word_summary: out of memory");
+  }
+  memcpy(e->word, word, len);
+  e->word[len] = '\0';
+  e->hash = hash;
+}
+
+bool word_summary_init(word_summary_t* summary, size_t cap) {
+  summary->nbuckets = 16;
+  while (summary->nbuckets < cap)
+    summary->nbuckets *= 2;
+  summary->entries = malloc(cap * sizeof(summary_entry_t));
+  summary->heap = malloc(cap * sizeof(summary_entry_t*));
+  summary->buckets = malloc(summary->nbuckets * sizeof(struct list));
+  if (summary->entries == NULL || summary->heap == NULL || summary->buckets == NULL) {
+    free(summary->entries);
+    free(summary->heap);
+    free(summary->buckets);
+    return false;
+  }
+  for (size_t i = 0; i < summary->nbuckets; i++)
+    list_init(&summary->buckets[i]);
+  summary->size = 0;
+  summary->cap = cap;
+  summary->total = 0;
+  return true;
+}
+
+void word_summary_add(word_summary_t* summary, const char* word, size_t len) {
+  uint64_t hash = word_hash(word, len);
+  summary_entry_t* e = find_entry(summary, word, len, hash);
+  summary->total++;
+  if (e != NULL) {
+    e->count++;
+    return;
+  }
+
+  if (summary->size < summary->cap) {
+    e = &summary->entries[summary->size];
+    e->word = NULL;
+    e->count = e->key = 1;
+    e->error = 0;
+    heap_set(summary, summary->size++, e);
+    sift_up(summary, e->heap_index);
+  } else {
+    /* Evict a smallest counter; the newcomer inherits its count as error */
+    e = settle_min(summary);
+    list_remove(&e->elem);
+    e->error = e->count;
+    e->key = ++e->count;
+    sift_down(summary, 0);
+  }
+  set_word(e, word, len, hash);
+  list_push_front(bucket_of(summary, hash), &e->elem);
+}
+
+/* Orders entries by descending count, then descending word. */
+static int cmp_greater(const summary_entry_t* x, const summary_entry_t* y) {
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return -strcmp(x->word, y->word);
+}
+
+static int cmp_entries(const void* a, const void* b) { return cmp_greater(a, b); }
+
+static int cmp_entry_ptrs(const void* a, const void* b) {
+  return cmp_greater(*(summary_entry_t* const*)a, *(summary_entry_t* const*)b);
+}
+
+/* Returns the most times a word missing from SUMMARY may have occurred. */
+static long missed_count(word_summary_t* summary) {
+  if (summary->size < summary->cap)
+    return 0;
+  return settle_min(summary)->count;
+}
+
+void word_summary_merge(word_summary_t* dst, word_summary_t* src) {
+  long dst_min = missed_count(dst);
+  long src_min = missed_count(src);
+  size_t n = 0;
+  summary_entry_t* all = malloc((dst->size + src->size) * sizeof(summary_entry_t) + 1);
+  if (all == NULL)
+    PANIC("word_summary: out of memory");
+
+  for (size_t i = 0; i < dst->size; i++) {
+    summary_entry_t* e = &dst->entries[i];
+    summary_entry_t* s = find_entry(src, e->word, strlen(e->word), e->hash);
+    if (s != NULL) {
+      e->count += s->count;
+      e->error += s->error;
+      free(s->word);
+      s->word = NULL;
+    } else {
+      e->count += src_min;
+      e->error += src_min;
+    }
+    all[n++] = *e;
+  }
+  for (size_t i = 0; i < src->size; i++) {
+    summary_entry_t* s = &src->entries[i];
+    if (s->word == NULL)
+      continue;
+    s->count += dst_min;
+    s->error += dst_min;
+    all[n++] = *s;
+  }
+
+  /* Keep the dst->cap largest counters */
+  if (n > dst->cap) {
+    qsort(all, n, sizeof(summary_entry_t), cmp_entries);
+    for (size_t i = dst->cap; i < n; i++)
+      free(all[i].word);
+    n = dst->cap;
+  }
+  for (size_t i = 0; i < dst->nbuckets; i++)
+    list_init(&dst->buckets[i]);
+  for (size_t i = 0; i < src->nbuckets; i++)
+    list_init(&src->buckets[i]);
+  for (size_t i = 0; i < n; i++) {
+    summary_entry_t* e = &dst->entries[i];
+    *e = all[i];
+    e->key = e->count;
+    heap_set(dst, i, e);
+    list_push_front(bucket_of(dst, e->hash), &e->elem);
+  }
+  dst->size = n;
+  for (size_t i = n / 2; i > 0; i--)
+    sift_down(dst, i - 1);
+  free(all);
+
+  dst->total += src->total;
+  src->size = 0;
+  src->total = 0;
+}
+
+long word_summary_bound(word_summary_t* summary) { return summary->total / (long)summary->cap; }
+
+size_t word_summary_top(word_summary_t* summary, size_t k, summary_entry_t** out) {
+  summary_entry_t** sorted = malloc(summary->size * sizeof(summary_entry_t*) + 1);
+  if (sorted == NULL)
+    PANIC("word_summary: out of memory");
+  for (size_t i = 0; i < summary->size; i++)
+    sorted[i] = &summary->entries[i];
+  qsort(sorted, summary->size, sizeof(summary_entry_t*), cmp_entry_ptrs);
+  if (k > summary->size)
+    k = summary->size;
+  for (size_t i = 0; i < k; i++)
+    out[i] = sorted[k - 1 - i];
+  free(sorted);
+  return k;
+}
+
+void word_summary_destroy(word_summary_t* summary) {
+  for (size_t i = 0; i < summary->size; i++)
+    free(summary->entries[i].word);
+  free(summary->entries);
+  free(summary->heap);
+  free(summary->buckets);
+  summary->entries = NULL;
+  summary->heap = NULL;
+  summary->buckets = NULL;
+  summary->size = summary->cap = 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * The word_summary interface counts heavy hitters approximately with the
+ * Space-Saving algorithm, in a fixed number of counters however large the
+ * input is.
+ *
+ * A summary with m counters that has seen N words keeps every word whose
+ * true frequency exceeds N/m. Each kept word has a count that never
+ * underestimates its frequency and an error such that count - error never
+ * overestimates it, and no error is larger than N/m.
+ *
+ * Summaries of disjoint inputs can be merged, so each thread may keep its
+ * own and combine them at the end.
+ */
+
+#ifndef WORD_SUMMARY_H
+#define WORD_SUMMARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+
+typedef struct summary_entry {
+  char* word;
+  long count;        /* Upper bound on the word's frequency */
+  long error;        /* count - error is a lower bound */
+  long key;          /* count when last placed in the heap, at most count */
+  uint64_t hash;     /* word_hash() of word */
+  size_t heap_index; /* Position in the summary's min-heap */
+  struct list_elem elem;
+} summary_entry_t;
+
+/*
+ * Entries are indexed by word in a hash table and by key in a min-heap.
+ * Counting a word only bumps its count, so a key may lag behind its count;
+ * stale keys are refreshed when they reach the top of the heap, which is
+ * enough to find the true smallest counter on eviction.
+ */
+typedef struct word_summary {
+  summary_entry_t* entries; /* cap counters, the first size in use */
+  summary_entry_t** heap;   /* Min-heap by key */
+  struct list* buckets;     /* Hash index from word to entry */
+  size_t nbuckets;
+  size_t size;
+  size_t cap; /* m, the number of counters */
+  long total; /* N, the number of words seen */
+} word_summary_t;
+
+/*
+ * Returns the number of counters needed for an error of at most EPSILON * N,
+ * reduced if necessary to fit in about MEMORY bytes. Either limit may be 0
+ * to leave it unset.
+ */
+size_t word_summary_capacity(double epsilon, size_t memory);
+
+/* Initialize a summary with CAP counters. Returns false if out of memory. */
+bool word_summary_init(word_summary_t* summary, size_t cap);
+
+/* Count one occurrence of the LEN-byte WORD, which is borrowed. */
+void word_summary_add(word_summary_t* summary, const char* word, size_t len);
+
+/* Combine SRC, a summary of other input, into DST. Leaves SRC empty. */
+void word_summary_merge(word_summary_t* dst, word_summary_t* src);
+
+/* Returns the largest error any entry can have, N/m. */
+long word_summary_bound(word_summary_t* summary);
+
+/*
+ * Store up to K entries with the highest counts in OUT, in the ascending
+ * order that less_count() sorts word counts in. Returns the number stored.
+ */
+size_t word_summary_top(word_summary_t* summary, size_t k, summary_entry_t** out);
+
+/* Free every entry and the summary's storage. */
+void word_summary_destroy(word_summary_t* summary);
+
+#endif /* WORD_SUMMARY_H */
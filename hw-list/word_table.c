@@ -0,0 +1,128 @@
+/*
+ * Implementation of the word_table interface: separate chaining over
+ * Pintos lists, doubled whenever the load factor exceeds one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "word_table.h"
+
+/* Number of buckets in a fresh table */
+#define WORD_TABLE_MIN_BUCKETS 1024
+
+static struct list* alloc_buckets(size_t nbuckets) {
+  struct list* buckets = malloc(nbuckets * sizeof(struct list));
+  if (buckets == NULL)
+    PANIC("word_table: out of memory");
+  for (size_t i = 0; i < nbuckets; i++)
+    list_init(&buckets[i]);
+  return buckets;
+}
+
+static inline struct list* bucket_of(word_table_t* table, const char* word, size_t len) {
+  return &table->buckets[word_hash(word, len) & (table->nbuckets - 1)];
+}
+
+static word_count_t* bucket_find(struct list* bucket, const char* word, size_t len) {
+  struct list_elem* e;
+  for (e = list_begin(bucket); e != list_end(bucket); e = list_next(e)) {
+    word_count_t* wc = list_entry(e, word_count_t, elem);
+    if (strncmp(wc->word, word, len) == 0 && wc->word[len] == '\0')
+      return wc;
+  }
+  return NULL;
+}
+
+/* Double the number of buckets and redistribute every entry. */
+static void grow(word_table_t* table) {
+  size_t old_nbuckets = table->nbuckets;
+  struct list* old = table->buckets;
+  table->nbuckets *= 2;
+  table->buckets = alloc_buckets(table->nbuckets);
+  for (size_t i = 0; i < old_nbuckets; i++) {
+    while (!list_empty(&old[i])) {
+      word_count_t* wc = list_entry(list_pop_front(&old[i]), word_count_t, elem);
+      list_push_front(bucket_of(table, wc->word, strlen(wc->word)), &wc->elem);
+    }
+  }
+  free(old);
+}
+
+void word_table_init(word_table_t* table) {
+  table->nbuckets = WORD_TABLE_MIN_BUCKETS;
+  table->buckets = alloc_buckets(table->nbuckets);
+  table->size = 0;
+}
+
+word_count_t* word_table_add(word_table_t* table, const char* word, size_t len, int count) {
+  struct list* bucket = bucket_of(table, word, len);
+  word_count_t* wc = bucket_find(bucket, word, len);
+  if (wc != NULL) {
+    wc->count += count;
+    return wc;
+  }
+
+  wc = malloc(sizeof(word_count_t));
+  if (wc == NULL || (wc->word = malloc(len + 1)) == NULL)
+    PANIC("word_table: out of memory");
+  memcpy(wc->word, word, len);
+  wc->word[len] = '\0';
+  wc->count = count;
+  list_push_front(bucket, &wc->elem);
+  if (++table->size > table->nbuckets)
+    grow(table);
+  return wc;
+}
+
+void word_table_merge(word_table_t* dst, word_table_t* src) {
+  for (size_t i = 0; i < src->nbuckets; i++) {
+    while (!list_empty(&src->buckets[i])) {
+      word_count_t* wc = list_entry(list_pop_front(&src->buckets[i]), word_count_t, elem);
+      size_t len = strlen(wc->word);
+      struct list* bucket = bucket_of(dst, wc->word, len);
+      word_count_t* found = bucket_find(bucket, wc->word, len);
+      if (found != NULL) {
+        found->count += wc->count;
+        free(wc->word);
+        free(wc);
+      } else {
+        list_push_front(bucket, &wc->elem);
+        if (++dst->size > dst->nbuckets)
+          grow(dst);
+      }
+    }
+  }
+  src->size = 0;
+}
+
+void word_table_drain(word_table_t* table, word_count_list_t* wclist) {
+#ifdef PTHREADS
+  struct list* lst = &wclist->lst;
+  pthread_mutex_lock(&wclist->lock);
+#else
+  struct list* lst = wclist;
+#endif
+  for (size_t i = 0; i < table->nbuckets; i++) {
+    while (!list_empty(&table->buckets[i]))
+      list_push_back(lst, list_pop_front(&table->buckets[i]));
+  }
+#ifdef PTHREADS
+  pthread_mutex_unlock(&wclist->lock);
+#endif
+  table->size = 0;
+}
+
+void word_table_destroy(word_table_t* table) {
+  for (size_t i = 0; i < table->nbuckets; i++) {
+    while (!list_empty(&table->buckets[i])) {
+      word_count_t* wc = list_entry(list_pop_front(&table->buckets[i]), word_count_t, elem);
+      free(wc->word);
+      free(wc);
+    }
+  }
+  free(table->buckets);
+  table->buckets = NULL;
+  table->nbuckets = table->size = 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * The word_table interface is a private (unsynchronized) hash table of
+ * word_count_t entries, meant to be owned by a single thread.
+ *
+ * Entries are chained into buckets through their list_elem, so a finished
+ * table can be drained into a word_count_list_t without copying and then
+ * printed and sorted through the word_count interface.
+ */
+
+#ifndef WORD_TABLE_H
+#define WORD_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "word_count.h"
+#include "word_scan.h"
+
+#ifndef PINTOS_LIST
+#error "PINTOS_LIST must be #define'd when using word_table.h"
+#endif
+
+typedef struct word_table {
+  struct list* buckets;
+  size_t nbuckets; /* Always a power of two */
+  size_t size;     /* Number of distinct words */
+} word_table_t;
+
+/* Initialize an empty word table. */
+void word_table_init(word_table_t* table);
+
+/*
+ * Add COUNT occurrences of the LEN-byte WORD. WORD is borrowed: a private
+ * copy is made only when the word is new to the table.
+ */
+word_count_t* word_table_add(word_table_t* table, const char* word, size_t len, int count);
+
+/*
+ * Move every entry of SRC into DST, adding the counts of words present in
+ * both. Leaves SRC empty.
+ */
+void word_table_merge(word_table_t* dst, word_table_t* src);
+
+/*
+ * Move every entry of TABLE onto the end of WCLIST, leaving TABLE empty.
+ * WCLIST must not already contain any of the words.
+ */
+void word_table_drain(word_table_t* table, word_count_list_t* wclist);
+
+/* Free the entries and buckets of TABLE. */
+void word_table_destroy(word_table_t* table);
+
+#endif /* WORD_TABLE_H */
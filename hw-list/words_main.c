@@ -0,0 +1,130 @@
+/*
+ * Word count application shared by words and lwords, which differ only in
+ * the word_count representation they are compiled against (PINTOS_LIST).
+ *
+ * With --top K only the K most frequent words are printed, selected with
+ * a bounded heap instead of sorting the whole list.
+ */
+
+/*
+ * Copyright © 2021 University of California, Berkeley
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "word_count.h"
+#include "word_heap.h"
+#include "word_helpers.h"
+
+/* Offer every entry of wclist to heap. */
+static void offer_words(word_heap_t* heap, word_count_list_t* wclist) {
+#ifdef PINTOS_LIST
+  struct list_elem* e;
+  for (e = list_begin(wclist); e != list_end(wclist); e = list_next(e))
+    word_heap_offer(heap, list_entry(e, word_count_t, elem));
+#else
+  for (word_count_t* wc = *wclist; wc != NULL; wc = wc->next)
+    word_heap_offer(heap, wc);
+#endif
+}
+
+/*
+ * Make top a list of the n entries in out, in that order. The entries are
+ * unlinked from whatever list they were on, which must not be used again.
+ */
+static void relink_words(word_count_list_t* top, word_count_t** out, size_t n) {
+#ifdef PINTOS_LIST
+  list_init(top);
+  for (size_t i = 0; i < n; i++) {
+    list_remove(&out[i]->elem);
+    list_push_back(top, &out[i]->elem);
+  }
+#else
+  *top = NULL;
+  for (size_t i = n; i > 0; i--) {
+    out[i - 1]->next = *top;
+    *top = out[i - 1];
+  }
+#endif
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "usage: %s [--top K] [file...]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+  static struct option long_options[] = {
+      {"top", required_argument, 0, 't'},
+      {0, 0, 0, 0},
+  };
+  long top = -1;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 't':
+        top = atol(optarg);
+        if (top < 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  /* Create the empty data structure. */
+  word_count_list_t word_counts;
+  init_words(&word_counts);
+
+  if (optind >= argc) {
+    count_words(&word_counts, stdin);
+  } else {
+    for (int i = optind; i < argc; i++) {
+      FILE* infile = fopen(argv[i], "r");
+      if (infile == NULL) {
+        perror("fopen");
+        return 1;
+      }
+      count_words(&word_counts, infile);
+      fclose(infile);
+    }
+  }
+
+  if (top >= 0) {
+    word_heap_t heap;
+    if ((size_t)top > len_words(&word_counts))
+      top = len_words(&word_counts);
+    if (!word_heap_init(&heap, top, less_count)) {
+      perror("malloc");
+      return 1;
+    }
+    offer_words(&heap, &word_counts);
+    size_t n = word_heap_drain(&heap, heap.items);
+
+    /* Print through fprint_words() so the format matches the full listing */
+    word_count_list_t top_counts;
+    relink_words(&top_counts, heap.items, n);
+    fprint_words(&top_counts, stdout);
+    word_heap_destroy(&heap);
+  } else {
+    wordcount_sort(&word_counts, less_count);
+    fprint_words(&word_counts, stdout);
+  }
+  return 0;
+}
@@ -1,26 +1,892 @@
 /*
  * mm_alloc.c
+ *
+ * A segregated-fit allocator over an sbrk heap.
+ *
+ * The heap is a run of chunks, each starting with a header word that holds
+ * its size and flags. Chunks are 16-byte aligned multiples of 16 bytes, so a
+ * chunk's payload, just after its header, is 16-byte aligned. A free chunk
+ * also keeps its size in its last word (a boundary tag), and the chunk after
+ * it has PREV_INUSE clear, so free() can find both neighbours and coalesce in
+ * constant time. There are never two free chunks side by side.
+ *
+ * Free chunks smaller than SMALL_LIMIT sit in exact-size bins, one list per
+ * 16-byte size class, with a bitmap of the non-empty bins. Larger free chunks
+ * sit in a treap ordered by size (and address, to break ties), searched for
+ * the best fit. Whatever is left at the end of the heap is the top chunk,
+ * which is split for requests nothing else fits and grown with sbrk.
+ * Requests of the mmap threshold or more get their own mapping. It starts
+ * at MMAP_THRESHOLD and, as in glibc, rises to the size of any larger
+ * mapped chunk freed, up to MMAP_THRESHOLD_MAX: a program that keeps
+ * freeing blocks of one large size gets them from the heap instead of
+ * paying for an mmap(), a munmap() and fresh page faults each time. The
+ * trim and release thresholds below rise with it to twice its new value,
+ * so those blocks are not given back between uses either.
+ *
+ * Free memory goes back to the system once it has stayed free for a while.
+ * A free that leaves the top chunk past the trim threshold, or a free chunk
+ * past the release threshold inside the heap, schedules a pass for
+ * RELEASE_DELAY later, run by the first malloc, free or realloc after that,
+ * even one the thread caches serve without locking. The pass lowers
+ * the break and drops the whole pages of large free chunks with
+ * madvise(MADV_DONTNEED), marking them RELEASED so later passes skip them.
+ * Memory freed and reused within the delay, as a growing realloc() does,
+ * never goes back at all. A process that makes no calls at all keeps what
+ * it holds; mm_trim() gives it back at once, after emptying the caches
+ * described below.
+ *
+ * realloc() resizes in place when it can: a chunk shrinks by splitting off
+ * its tail, and grows into a free chunk or the top chunk after it. Mapped
+ * chunks are resized with mremap(), which moves pages rather than bytes.
+ *
+ * One lock covers the heap, so small chunks are handed out through two
+ * layers of caches in front of it. Each thread keeps lists of free small
+ * chunks by size class and allocates and frees from them without locking.
+ * An empty list refills, and an overfull one flushes, a batch at a time
+ * from a central list per class, each with its own lock. Only when a
+ * central list runs dry or grows too long is the heap itself locked. Cached
+ * chunks stay marked in use, so the heap never coalesces them. Building with
+ * MM_NO_TCACHE leaves the caches out.
+ *
+ * Blocks the heap profiler (mm_profile.c) has sampled are marked SAMPLED, so
+ * only their frees need to tell it.
  */
 
+#define _GNU_SOURCE
 #include "mm_alloc.h"
+#include "mm_profile.h"
 
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
-void* mm_malloc(size_t size) {
-  //TODO: Implement malloc
+#define ALIGNMENT 16
+#define HEADER_SIZE sizeof(size_t)
+#define MIN_CHUNK 32 /* Header, two list links and the boundary tag */
+
+/* Free chunks below this size are kept in exact-size bins, the rest in the treap */
+#define SMALL_LIMIT 1024
+#define NSMALLBINS (SMALL_LIMIT / ALIGNMENT)
+
+/* Requests this large are mapped on their own, at first; see mmap_threshold */
+#define MMAP_THRESHOLD (256 * 1024)
+
+/* The most the mmap threshold rises to */
+#define MMAP_THRESHOLD_MAX (32 * 1024 * 1024)
+
+/* The heap grows by at least this much at a time */
+#define SBRK_GRANULE (128 * 1024)
+
+/* The break is lowered when the top chunk grows this large, down to SBRK_GRANULE, at first */
+#define TRIM_THRESHOLD (1024 * 1024)
+
+/* Free chunks this large give their pages back, at first */
+#define RELEASE_THRESHOLD (256 * 1024)
+
+/* How long memory stays free before it goes back, in nanoseconds */
+#define RELEASE_DELAY (10 * 1000 * 1000)
+
+/* Chunks a thread caches per size class before flushing, and moved per refill or flush */
+#define TCACHE_MAX 64
+#define TCACHE_BATCH 32
 
-  return NULL;
+/* Chunks a central list holds before returning a batch to the heap */
+#define CENTRAL_MAX 1024
+
+/* Flags in the low bits of a chunk header */
+#define INUSE 1
+#define PREV_INUSE 2
+#define MMAPPED 4
+#define SAMPLED 8
+#define FLAGS (INUSE | PREV_INUSE | MMAPPED | SAMPLED)
+/* Set in a free chunk whose pages have been dropped; SAMPLED is only used in in-use ones */
+#define RELEASED SAMPLED
+
+typedef struct chunk {
+  size_t head;
+  /* The rest is only valid while the chunk is free and small */
+  struct chunk* next;
+  struct chunk* prev;
+} chunk_t;
+
+typedef struct tree_chunk {
+  size_t head;
+  /* The rest is only valid while the chunk is free and large */
+  struct tree_chunk* left;
+  struct tree_chunk* right;
+} tree_chunk_t;
+
+static struct {
+  chunk_t* bins[NSMALLBINS];
+  uint64_t binmap; /* Bit I set if bins[I] is not empty */
+  tree_chunk_t* tree;
+  chunk_t* top;   /* The last chunk of the heap, never in a bin */
+  char* heap_brk;       /* The break as last moved by us */
+  uint64_t release_due; /* When the next release pass may run, or 0 if none is due. Read
+                           without the lock by release_check(). */
+  pthread_mutex_t lock;
+} heap = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static inline size_t chunk_size(const void* c) {
+  return ((const chunk_t*)c)->head & ~(size_t)FLAGS;
 }
 
-void* mm_realloc(void* ptr, size_t size) {
-  //TODO: Implement realloc
+static inline chunk_t* chunk_at(void* c, size_t offset) { return (chunk_t*)((char*)c + offset); }
+
+static inline void* chunk2mem(chunk_t* c) { return (char*)c + HEADER_SIZE; }
+
+static inline chunk_t* mem2chunk(void* p) { return (chunk_t*)((char*)p - HEADER_SIZE); }
+
+/* Sets the boundary tag of free chunk C of SIZE bytes */
+static inline void set_foot(chunk_t* c, size_t size) {
+  *(size_t*)((char*)c + size - HEADER_SIZE) = size;
+}
+
+/* The size of the free chunk before C, from its boundary tag */
+static inline size_t prev_foot(chunk_t* c) { return *((size_t*)c - 1); }
+
+/* The chunk size serving a request of N bytes, or 0 if N is too large */
+static inline size_t request2size(size_t n) {
+  if (n > SIZE_MAX / 2)
+    return 0;
+  size_t size = (n + HEADER_SIZE + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+  return size < MIN_CHUNK ? MIN_CHUNK : size;
+}
+
+/* Usable bytes in the payload of in-use chunk C */
+static inline size_t usable_size(chunk_t* c) {
+  return chunk_size(c) - (c->head & MMAPPED ? 2 * HEADER_SIZE : HEADER_SIZE);
+}
+
+/* Treap of large free chunks */
+
+static inline uint32_t tree_priority(const tree_chunk_t* t) {
+  return (uint32_t)(((uintptr_t)t * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static inline bool tree_less(const tree_chunk_t* a, const tree_chunk_t* b) {
+  size_t sa = chunk_size(a), sb = chunk_size(b);
+  return sa < sb || (sa == sb && a < b);
+}
+
+static tree_chunk_t* tree_insert(tree_chunk_t* root, tree_chunk_t* t) {
+  if (root == NULL) {
+    t->left = t->right = NULL;
+    return t;
+  }
+  if (tree_less(t, root)) {
+    root->left = tree_insert(root->left, t);
+    if (tree_priority(root->left) > tree_priority(root)) {
+      tree_chunk_t* l = root->left;
+      root->left = l->right;
+      l->right = root;
+      return l;
+    }
+  } else {
+    root->right = tree_insert(root->right, t);
+    if (tree_priority(root->right) > tree_priority(root)) {
+      tree_chunk_t* r = root->right;
+      root->right = r->left;
+      r->left = root;
+      return r;
+    }
+  }
+  return root;
+}
+
+/* Joins treaps A and B, every key of A being less than every key of B */
+static tree_chunk_t* tree_join(tree_chunk_t* a, tree_chunk_t* b) {
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (tree_priority(a) > tree_priority(b)) {
+    a->right = tree_join(a->right, b);
+    return a;
+  }
+  b->left = tree_join(a, b->left);
+  return b;
+}
+
+static tree_chunk_t* tree_remove(tree_chunk_t* root, tree_chunk_t* t) {
+  if (root == t)
+    return tree_join(t->left, t->right);
+  if (tree_less(t, root))
+    root->left = tree_remove(root->left, t);
+  else
+    root->right = tree_remove(root->right, t);
+  return root;
+}
+
+/* The smallest free chunk of at least SIZE bytes, lowest address first */
+static tree_chunk_t* tree_best_fit(size_t size) {
+  tree_chunk_t* best = NULL;
+  for (tree_chunk_t* t = heap.tree; t != NULL;) {
+    if (chunk_size(t) >= size) {
+      best = t;
+      t = t->left;
+    } else {
+      t = t->right;
+    }
+  }
+  return best;
+}
+
+/* Free lists */
+
+static void unlink_free(chunk_t* c) {
+  size_t size = chunk_size(c);
+  if (size >= SMALL_LIMIT) {
+    heap.tree = tree_remove(heap.tree, (tree_chunk_t*)c);
+    return;
+  }
+  size_t i = size / ALIGNMENT;
+  if (c->prev != NULL)
+    c->prev->next = c->next;
+  else if ((heap.bins[i] = c->next) == NULL)
+    heap.binmap &= ~(1ULL << i);
+  if (c->next != NULL)
+    c->next->prev = c->prev;
+}
+
+/* Makes C a free chunk of SIZE bytes and files it. The chunk before C is in use. */
+static void insert_free(chunk_t* c, size_t size) {
+  c->head = size | PREV_INUSE;
+  set_foot(c, size);
+  chunk_at(c, size)->head &= ~(size_t)PREV_INUSE;
+  if (size >= SMALL_LIMIT) {
+    heap.tree = tree_insert(heap.tree, (tree_chunk_t*)c);
+    return;
+  }
+  size_t i = size / ALIGNMENT;
+  c->prev = NULL;
+  c->next = heap.bins[i];
+  if (c->next != NULL)
+    c->next->prev = c;
+  heap.bins[i] = c;
+  heap.binmap |= 1ULL << i;
+}
+
+/* Marks free chunk C in use as a chunk of SIZE bytes, filing any remainder */
+static void* use_chunk(chunk_t* c, size_t size) {
+  size_t have = chunk_size(c);
+  size_t prev_inuse = c->head & PREV_INUSE;
+  if (have - size >= MIN_CHUNK) {
+    c->head = size | INUSE | prev_inuse;
+    insert_free(chunk_at(c, size), have - size);
+  } else {
+    c->head = have | INUSE | prev_inuse;
+    chunk_at(c, have)->head |= PREV_INUSE;
+  }
+  return chunk2mem(c);
+}
+
+/* The top chunk */
+
+/* Grows the heap so the top chunk can serve a chunk of SIZE bytes */
+static bool extend_heap(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t top_size = heap.top ? chunk_size(heap.top) : 0;
+  size_t incr = size + MIN_CHUNK + ALIGNMENT;
+  incr = incr < SBRK_GRANULE ? SBRK_GRANULE : (incr + page - 1) & ~(page - 1);
+  char* base = sbrk(incr);
+  if (base == (char*)-1)
+    return false;
+
+  if (heap.top != NULL && base == heap.heap_brk) {
+    /* Contiguous: the top chunk just gets longer */
+    heap.heap_brk = base + incr;
+    top_size = (heap.heap_brk - (char*)heap.top) & ~(size_t)(ALIGNMENT - 1);
+    heap.top->head = top_size | (heap.top->head & PREV_INUSE);
+    return true;
+  }
+
+  if (heap.top != NULL) {
+    /* Someone else moved the break. Retire the old top behind an in-use fencepost
+       that keeps coalescing from running off its end. */
+    chunk_t* top = heap.top;
+    chunk_t* fence = chunk_at(top, top_size - ALIGNMENT);
+    if (top_size - ALIGNMENT >= MIN_CHUNK) {
+      fence->head = ALIGNMENT | INUSE;
+      insert_free(top, top_size - ALIGNMENT);
+    } else {
+      top->head = top_size | INUSE | (top->head & PREV_INUSE);
+    }
+  }
+  /* A header at 8 mod 16 puts the payload on a 16-byte boundary */
+  uintptr_t payload = ((uintptr_t)base + HEADER_SIZE + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+  char* start = (char*)(payload - HEADER_SIZE);
+  heap.heap_brk = base + incr;
+  heap.top = (chunk_t*)start;
+  heap.top->head = ((heap.heap_brk - start) & ~(size_t)(ALIGNMENT - 1)) | PREV_INUSE;
+  return chunk_size(heap.top) >= size + MIN_CHUNK;
+}
+
+/* Splits a chunk of SIZE bytes off the front of the top chunk */
+static void* take_top(size_t size) {
+  if ((heap.top == NULL || chunk_size(heap.top) < size + MIN_CHUNK) && !extend_heap(size))
+    return NULL;
+  chunk_t* c = heap.top;
+  size_t top_size = chunk_size(c);
+  c->head = size | INUSE | (c->head & PREV_INUSE);
+  heap.top = chunk_at(c, size);
+  heap.top->head = (top_size - size) | PREV_INUSE;
+  return chunk2mem(c);
+}
+
+/* Huge chunks */
+
+/* Requests at least this large are mapped, and free memory this large goes back; all
+   three only rise, with mmap_threshold, and are read without a lock */
+static size_t mmap_threshold = MMAP_THRESHOLD;
+static size_t trim_threshold = TRIM_THRESHOLD;
+static size_t release_threshold = RELEASE_THRESHOLD;
+
+/* Maps a chunk for a request of SIZE bytes. Its header sits one word into the
+   mapping, which keeps the payload aligned, and holds the mapping's length. */
+static void* mmap_chunk(size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t length = (size + 2 * HEADER_SIZE + page - 1) & ~(page - 1);
+  char* map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED)
+    return NULL;
+  chunk_t* c = (chunk_t*)(map + HEADER_SIZE);
+  c->head = length | MMAPPED | INUSE;
+  return chunk2mem(c);
+}
+
+static void munmap_chunk(chunk_t* c) { munmap((char*)c - HEADER_SIZE, chunk_size(c)); }
+
+/* Resizes mapped chunk C for a request of SIZE bytes, letting the kernel move it */
+static void* mremap_chunk(chunk_t* c, size_t size) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t length = (size + 2 * HEADER_SIZE + page - 1) & ~(page - 1);
+  if (length == chunk_size(c))
+    return chunk2mem(c);
+  char* map = mremap((char*)c - HEADER_SIZE, chunk_size(c), length, MREMAP_MAYMOVE);
+  if (map == MAP_FAILED)
+    return NULL;
+  c = (chunk_t*)(map + HEADER_SIZE);
+  c->head = length | MMAPPED | INUSE;
+  return chunk2mem(c);
+}
+
+/* Giving memory back */
+
+/* Lowers the break to leave the top chunk PAD bytes or so, if no one else has moved it.
+   Returns the bytes given back. */
+static size_t trim_top(size_t pad) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  char* top = (char*)heap.top;
+  char* keep = (char*)(((uintptr_t)top + MIN_CHUNK + pad + page - 1) & ~(uintptr_t)(page - 1));
+  if (heap.top == NULL || keep >= heap.heap_brk || sbrk(0) != heap.heap_brk)
+    return 0;
+  size_t release = heap.heap_brk - keep;
+  if (sbrk(-(intptr_t)release) == (void*)-1)
+    return 0;
+  heap.heap_brk = keep;
+  heap.top->head = ((keep - top) & ~(size_t)(ALIGNMENT - 1)) | (heap.top->head & PREV_INUSE);
+  return release;
+}
+
+/* Drops the whole pages of free chunk T, keeping its header, tree links and boundary tag,
+   and marks it RELEASED. Returns the bytes given back. */
+static size_t release_pages(tree_chunk_t* t) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t start = ((uintptr_t)t + sizeof(tree_chunk_t) + page - 1) & ~(uintptr_t)(page - 1);
+  uintptr_t end = ((uintptr_t)t + chunk_size(t) - HEADER_SIZE) & ~(uintptr_t)(page - 1);
+  t->head |= RELEASED;
+  if (start >= end || madvise((void*)start, end - start, MADV_DONTNEED) != 0)
+    return 0;
+  return end - start;
+}
+
+/* Releases the pages of the free chunks of at least MIN bytes in treap T not yet released */
+static size_t release_tree(tree_chunk_t* t, size_t min) {
+  size_t released = 0;
+  for (; t != NULL; t = t->right) {
+    if (chunk_size(t) < min)
+      continue; /* Everything to its left is smaller still */
+    released += release_tree(t->left, min);
+    if (!(t->head & RELEASED))
+      released += release_pages(t);
+  }
+  return released;
+}
 
-  return NULL;
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Arranges for a release pass RELEASE_DELAY from now, unless one is already due */
+static void schedule_release(void) {
+  if (heap.release_due == 0)
+    __atomic_store_n(&heap.release_due, now_ns() + RELEASE_DELAY, __ATOMIC_RELAXED);
+}
+
+/* Gives back what is still free once the delay is over */
+static void release_pass(void) {
+  if (now_ns() < heap.release_due)
+    return;
+  __atomic_store_n(&heap.release_due, 0, __ATOMIC_RELAXED);
+  if (chunk_size(heap.top) >= __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED))
+    trim_top(SBRK_GRANULE);
+  release_tree(heap.tree, __atomic_load_n(&release_threshold, __ATOMIC_RELAXED));
+}
+
+/* Runs a release pass that has come due, from calls that may not take the heap lock.
+   Costs a load while none is scheduled; a thread that finds the lock busy leaves the
+   pass to the holder's next call. */
+static inline void release_check(void) {
+  uint64_t due = __atomic_load_n(&heap.release_due, __ATOMIC_RELAXED);
+  if (__builtin_expect(due == 0, 1) || now_ns() < due)
+    return;
+  if (pthread_mutex_trylock(&heap.lock) == 0) {
+    if (heap.release_due != 0)
+      release_pass();
+    pthread_mutex_unlock(&heap.lock);
+  }
+}
+
+/* Allocation proper, with the lock held */
+static void* heap_alloc(size_t size) {
+  if (size < SMALL_LIMIT) {
+    /* The exact bin, else the smallest non-empty larger one */
+    size_t i = size / ALIGNMENT;
+    uint64_t bins = heap.binmap & (~0ULL << i);
+    if (bins != 0) {
+      chunk_t* c = heap.bins[__builtin_ctzll(bins)];
+      unlink_free(c);
+      return use_chunk(c, size);
+    }
+  }
+  tree_chunk_t* t = tree_best_fit(size);
+  if (t != NULL) {
+    unlink_free((chunk_t*)t);
+    return use_chunk((chunk_t*)t, size);
+  }
+  return take_top(size);
+}
+
+/* Frees C, with the lock held */
+static void heap_free(chunk_t* c) {
+  /* Before C joins the free memory, so the pass leaves it alone */
+  if (heap.release_due != 0)
+    release_pass();
+  size_t size = chunk_size(c);
+  chunk_t* next = chunk_at(c, size);
+  if (!(c->head & PREV_INUSE)) {
+    size_t prev_size = prev_foot(c);
+    c = (chunk_t*)((char*)c - prev_size);
+    unlink_free(c);
+    size += prev_size;
+  }
+  if (next == heap.top) {
+    heap.top = c;
+    c->head = (size + chunk_size(next)) | PREV_INUSE;
+    if (chunk_size(c) >= __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED))
+      schedule_release();
+  } else {
+    if (!(next->head & INUSE)) {
+      unlink_free(next);
+      size += chunk_size(next);
+    }
+    insert_free(c, size);
+    if (size >= __atomic_load_n(&release_threshold, __ATOMIC_RELAXED))
+      schedule_release();
+  }
+}
+
+#ifndef MM_NO_TCACHE
+
+/* Caches of small chunks, linked through their next fields, by size class */
+
+static struct central {
+  pthread_mutex_t lock;
+  chunk_t* list;
+  size_t count;
+} central[NSMALLBINS];
+
+static pthread_once_t central_once = PTHREAD_ONCE_INIT;
+
+/* Flushes a thread's cache when the thread exits */
+static pthread_key_t tcache_key;
+
+static __thread struct tcache {
+  chunk_t* lists[NSMALLBINS];
+  unsigned counts[NSMALLBINS];
+  bool registered;
+} tcache;
+
+static void tcache_destroy(void* arg);
+
+static void central_init(void) {
+  for (int i = 0; i < NSMALLBINS; i++)
+    pthread_mutex_init(&central[i].lock, NULL);
+  pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/* Cuts a batch of chunks of SIZE bytes out of the heap onto *LIST, the last one taking any
+   slack. Returns how many it cut. */
+static unsigned heap_carve(size_t size, chunk_t** list) {
+  pthread_mutex_lock(&heap.lock);
+  unsigned n = TCACHE_BATCH;
+  void* p = heap_alloc(n * size);
+  if (p == NULL) {
+    n = 1;
+    p = heap_alloc(size);
+  }
+  if (p == NULL) {
+    pthread_mutex_unlock(&heap.lock);
+    return 0;
+  }
+
+  /* Split under the lock: a free of the chunk before this one updates
+     the first header's PREV_INUSE bit at the same time */
+  chunk_t* c = mem2chunk(p);
+  size_t left = chunk_size(c);
+  size_t prev_inuse = c->head & PREV_INUSE;
+  for (unsigned k = 0; k < n; k++) {
+    size_t csize = k == n - 1 ? left : size;
+    c->head = csize | INUSE | prev_inuse;
+    prev_inuse = PREV_INUSE;
+    c->next = *list;
+    *list = c;
+    c = chunk_at(c, csize);
+    left -= csize;
+  }
+  pthread_mutex_unlock(&heap.lock);
+  return n;
+}
+
+/* Moves up to a batch of chunks of class I from the central list, or the heap, to the
+   thread's cache */
+static void tcache_refill(size_t i) {
+  struct central* central_list = &central[i];
+  chunk_t* list = NULL;
+  unsigned n = 0;
+  pthread_mutex_lock(&central_list->lock);
+  while (n < TCACHE_BATCH && central_list->list != NULL) {
+    chunk_t* c = central_list->list;
+    central_list->list = c->next;
+    c->next = list;
+    list = c;
+    n++;
+  }
+  central_list->count -= n;
+  pthread_mutex_unlock(&central_list->lock);
+  if (n == 0)
+    n = heap_carve(i * ALIGNMENT, &list);
+
+  tcache.counts[i] += n;
+  while (list != NULL) {
+    chunk_t* c = list;
+    list = c->next;
+    c->next = tcache.lists[i];
+    tcache.lists[i] = c;
+  }
+}
+
+/* Moves N chunks of class I from the thread's cache to the central list. If that grows too
+   long, a batch goes back to the heap to be coalesced. */
+static void tcache_flush(size_t i, unsigned n) {
+  chunk_t* first = tcache.lists[i];
+  chunk_t* last = first;
+  for (unsigned k = 1; k < n; k++)
+    last = last->next;
+  tcache.lists[i] = last->next;
+  tcache.counts[i] -= n;
+
+  struct central* central_list = &central[i];
+  chunk_t* release = NULL;
+  pthread_mutex_lock(&central_list->lock);
+  last->next = central_list->list;
+  central_list->list = first;
+  central_list->count += n;
+  if (central_list->count > CENTRAL_MAX) {
+    release = central_list->list;
+    chunk_t* c = release;
+    for (unsigned k = 1; k < TCACHE_BATCH; k++)
+      c = c->next;
+    central_list->list = c->next;
+    central_list->count -= TCACHE_BATCH;
+    c->next = NULL;
+  }
+  pthread_mutex_unlock(&central_list->lock);
+
+  if (release != NULL) {
+    pthread_mutex_lock(&heap.lock);
+    while (release != NULL) {
+      chunk_t* c = release;
+      release = c->next;
+      heap_free(c);
+    }
+    pthread_mutex_unlock(&heap.lock);
+  }
+}
+
+static void tcache_destroy(void* arg) {
+  (void)arg;
+  for (size_t i = 0; i < NSMALLBINS; i++)
+    if (tcache.counts[i] > 0)
+      tcache_flush(i, tcache.counts[i]);
+  tcache.registered = false;
+}
+
+/* Arranges for the thread's cache to be flushed when it exits */
+static void tcache_register(void) {
+  pthread_once(&central_once, central_init);
+  pthread_setspecific(tcache_key, &tcache);
+  tcache.registered = true;
+}
+
+/* A chunk of SIZE bytes, a small size class, from the thread's cache */
+static void* tcache_alloc(size_t size) {
+  size_t i = size / ALIGNMENT;
+  if (tcache.lists[i] == NULL) {
+    if (!tcache.registered)
+      tcache_register();
+    tcache_refill(i);
+    if (tcache.lists[i] == NULL)
+      return NULL;
+  }
+  chunk_t* c = tcache.lists[i];
+  tcache.lists[i] = c->next;
+  tcache.counts[i]--;
+  return chunk2mem(c);
+}
+
+/* Keeps small in-use chunk C in the thread's cache */
+static void tcache_free(chunk_t* c) {
+  size_t i = chunk_size(c) / ALIGNMENT;
+  if (!tcache.registered)
+    tcache_register();
+  c->next = tcache.lists[i];
+  tcache.lists[i] = c;
+  if (++tcache.counts[i] > TCACHE_MAX)
+    tcache_flush(i, TCACHE_BATCH);
+}
+
+#endif /* MM_NO_TCACHE */
+
+/* Resizing in place */
+
+/* Cuts in-use chunk C down to SIZE bytes, freeing the tail if it is big enough to be a
+   chunk. With the lock held. */
+static void shrink_chunk(chunk_t* c, size_t size) {
+  size_t have = chunk_size(c);
+  if (have - size < MIN_CHUNK)
+    return;
+  chunk_t* tail = chunk_at(c, size);
+  c->head = size | (c->head & FLAGS);
+  tail->head = (have - size) | INUSE | PREV_INUSE;
+  heap_free(tail);
+}
+
+/* Grows in-use chunk C to at least SIZE bytes into the free chunk or the top chunk after it.
+   Returns false, leaving C alone, if there is not room. With the lock held. */
+static bool grow_chunk(chunk_t* c, size_t size) {
+  size_t have = chunk_size(c);
+  chunk_t* next = chunk_at(c, have);
+  if (next == heap.top) {
+    if (chunk_size(next) < size - have + MIN_CHUNK) {
+      /* The heap may only grow somewhere else, leaving C's top behind */
+      if (!extend_heap(size - have) || next != heap.top ||
+          chunk_size(next) < size - have + MIN_CHUNK)
+        return false;
+    }
+    size_t top_size = chunk_size(next);
+    c->head = size | (c->head & FLAGS);
+    heap.top = chunk_at(c, size);
+    heap.top->head = (have + top_size - size) | PREV_INUSE;
+    return true;
+  }
+  if (next->head & INUSE || have + chunk_size(next) < size)
+    return false;
+  unlink_free(next);
+  c->head = (have + chunk_size(next)) | (c->head & FLAGS);
+  chunk_at(c, chunk_size(c))->head |= PREV_INUSE;
+  shrink_chunk(c, size);
+  return true;
+}
+
+/* The interface, less profiling */
+
+static void* alloc_mem(size_t size) {
+  release_check();
+  if (size == 0)
+    return NULL;
+  size_t csize = request2size(size);
+  if (csize == 0)
+    return NULL;
+  if (csize >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+    return mmap_chunk(size);
+  void* p = NULL;
+#ifndef MM_NO_TCACHE
+  if (csize < SMALL_LIMIT)
+    p = tcache_alloc(csize);
+#endif
+  if (p == NULL) {
+    pthread_mutex_lock(&heap.lock);
+    p = heap_alloc(csize);
+    pthread_mutex_unlock(&heap.lock);
+  }
+  /* Out of break, perhaps; a mapping may still be had */
+  return p != NULL ? p : mmap_chunk(size);
+}
+
+static void free_mem(void* ptr) {
+  release_check();
+  if (ptr == NULL)
+    return;
+  chunk_t* c = mem2chunk(ptr);
+  if (c->head & MMAPPED) {
+    /* Serve this size from the heap from now on */
+    size_t size = chunk_size(c);
+    if (size > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) && size <= MMAP_THRESHOLD_MAX) {
+      __atomic_store_n(&mmap_threshold, size, __ATOMIC_RELAXED);
+      if (2 * size > __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED))
+        __atomic_store_n(&trim_threshold, 2 * size, __ATOMIC_RELAXED);
+      __atomic_store_n(&release_threshold, 2 * size, __ATOMIC_RELAXED);
+    }
+    munmap_chunk(c);
+    return;
+  }
+#ifndef MM_NO_TCACHE
+  if (chunk_size(c) < SMALL_LIMIT) {
+    tcache_free(c);
+    return;
+  }
+#endif
+  pthread_mutex_lock(&heap.lock);
+  heap_free(c);
+  pthread_mutex_unlock(&heap.lock);
+}
+
+static void* realloc_mem(void* ptr, size_t size) {
+  if (ptr == NULL)
+    return alloc_mem(size);
+  if (size == 0) {
+    free_mem(ptr);
+    return NULL;
+  }
+  release_check();
+  size_t csize = request2size(size);
+  if (csize == 0)
+    return NULL;
+  chunk_t* c = mem2chunk(ptr);
+  size_t have = usable_size(c);
+  if (c->head & MMAPPED) {
+    if (csize >= MMAP_THRESHOLD)
+      return mremap_chunk(c, size);
+  } else if (csize <= chunk_size(c)) {
+    if (chunk_size(c) - csize >= MIN_CHUNK) {
+      pthread_mutex_lock(&heap.lock);
+      shrink_chunk(c, csize);
+      pthread_mutex_unlock(&heap.lock);
+    }
+    return ptr;
+  } else {
+    pthread_mutex_lock(&heap.lock);
+    bool grown = grow_chunk(c, csize);
+    pthread_mutex_unlock(&heap.lock);
+    if (grown)
+      return ptr;
+  }
+
+  /* Moving between the heap and a mapping, or no room to grow */
+  void* p = alloc_mem(size);
+  if (p == NULL)
+    return NULL;
+  memcpy(p, ptr, have < size ? have : size);
+  free_mem(ptr);
+  return p;
+}
+
+/* Profiling hooks, out of line so the backtrace has a known number of frames above the
+   caller of mm_malloc() or mm_realloc() */
+
+static __attribute__((noinline)) void* profile_alloc(void* p, size_t size) {
+  mm_profile_poll();
+  if (p != NULL && mm_profile_sample(size)) {
+    mm_profile_record(p, size);
+    /* Other threads change the flags of in-use chunks under the lock */
+    pthread_mutex_lock(&heap.lock);
+    mem2chunk(p)->head |= SAMPLED;
+    pthread_mutex_unlock(&heap.lock);
+  }
+  return p;
+}
+
+static void profile_free(void* p) {
+  mm_profile_poll();
+  chunk_t* c = mem2chunk(p);
+  if (c->head & SAMPLED) {
+    pthread_mutex_lock(&heap.lock);
+    c->head &= ~(size_t)SAMPLED;
+    pthread_mutex_unlock(&heap.lock);
+    mm_profile_forget(p);
+  }
+}
+
+void* mm_malloc(size_t size) {
+  void* p = alloc_mem(size);
+  if (__builtin_expect(mm_profile_enabled, 0))
+    p = profile_alloc(p, size);
+  return p;
+}
+
+void* mm_realloc(void* ptr, size_t size) {
+  /* A resized block is sampled afresh, as if freed and allocated again */
+  if (__builtin_expect(mm_profile_enabled, 0) && ptr != NULL)
+    profile_free(ptr);
+  void* p = realloc_mem(ptr, size);
+  if (__builtin_expect(mm_profile_enabled, 0))
+    p = profile_alloc(p, size);
+  return p;
 }
 
 void mm_free(void* ptr) {
-  //TODO: Implement free
+  if (__builtin_expect(mm_profile_enabled, 0) && ptr != NULL)
+    profile_free(ptr);
+  free_mem(ptr);
+}
+
+int mm_trim(size_t pad) {
+#ifndef MM_NO_TCACHE
+  /* Only the calling thread's cache can be emptied; other threads own theirs */
+  pthread_once(&central_once, central_init);
+  for (size_t i = 0; i < NSMALLBINS; i++)
+    if (tcache.counts[i] > 0)
+      tcache_flush(i, tcache.counts[i]);
+  for (size_t i = 0; i < NSMALLBINS; i++) {
+    pthread_mutex_lock(&central[i].lock);
+    chunk_t* list = central[i].list;
+    central[i].list = NULL;
+    central[i].count = 0;
+    pthread_mutex_unlock(&central[i].lock);
+    if (list == NULL)
+      continue;
+    pthread_mutex_lock(&heap.lock);
+    while (list != NULL) {
+      chunk_t* c = list;
+      list = c->next;
+      heap_free(c);
+    }
+    pthread_mutex_unlock(&heap.lock);
+  }
+#endif
+  pthread_mutex_lock(&heap.lock);
+  __atomic_store_n(&heap.release_due, 0, __ATOMIC_RELAXED);
+  size_t released = trim_top(pad) + release_tree(heap.tree, 0);
+  pthread_mutex_unlock(&heap.lock);
+  return released > 0;
 }
@@ -15,4 +15,52 @@ void* mm_malloc(size_t size);
 void* mm_realloc(void* ptr, size_t size);
 void mm_free(void* ptr);
 
+/* Gives free memory back to the system: lowers the break to leave PAD bytes free at the
+   top of the heap, and drops the pages of large free blocks within it. The calling
+   thread's cache of small blocks is emptied first. Returns 1 if any memory was given
+   back, else 0, as malloc_trim() does. */
+int mm_trim(size_t pad);
+
+/* Samples the call sites of about one in every SAMPLE_BYTES bytes allocated, as setting
+   MM_PROFILE=SAMPLE_BYTES in the environment does; 0 stops sampling */
+void mm_profile_start(size_t sample_bytes);
+
+/* Writes a pprof heap profile of the sampled blocks still live to PATH; returns 0, or -1
+   with errno set */
+int mm_profile_dump(const char* path);
+
+/*
+ * Pools of objects of one size, carved from slabs of whole pages that never
+ * touch the heap. Objects are not interchangeable with mm_malloc()'s blocks.
+ */
+typedef struct mm_pool mm_pool_t;
+
+struct mm_pool_stats {
+  size_t object_size; /* Bytes per object, rounded up for alignment */
+  size_t slab_size;   /* Bytes per slab */
+  size_t slabs;       /* Slabs in use, and one spare at most */
+  size_t mapped;      /* Bytes mapped for slabs, used or not, or with their pages dropped */
+  size_t in_use;      /* Objects allocated and not yet freed */
+  size_t cached;      /* Free objects held in threads' magazines */
+  size_t allocs;
+  size_t frees;
+};
+
+/* A pool of SIZE-byte objects aligned to ALIGN, a power of two, or to 16 if ALIGN is 0;
+   NULL on failure */
+mm_pool_t* mm_pool_create(size_t size, size_t align);
+
+/* Gives each thread using POOL a magazine of up to ROUNDS free objects to allocate from
+   and free to without locking. Only before the pool's first use; returns 0, or -1. */
+int mm_pool_set_magazines(mm_pool_t* pool, unsigned rounds);
+
+void* mm_pool_alloc(mm_pool_t* pool);
+void mm_pool_free(mm_pool_t* pool, void* obj);
+
+/* Fills STATS in with POOL's state and counts */
+void mm_pool_stats(mm_pool_t* pool, struct mm_pool_stats* stats);
+
+/* Unmaps every slab of POOL, freeing all its objects at once */
+void mm_pool_destroy(mm_pool_t* pool);
+
 #endif
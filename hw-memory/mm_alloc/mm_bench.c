@@ -0,0 +1,202 @@
+/*
+ * Measure how allocation throughput scales with threads.
+ *
+ * Usage: mm_bench [-t max_threads] [-n ops_per_thread] [-l live_blocks]
+ *
+ * Each thread keeps L live blocks of 16 to 512 bytes and, N times, frees
+ * a random one and allocates a new block of a random size in its place,
+ * touching its first and last bytes. A thread in eight hands its blocks
+ * to the next thread to free instead, so frees also cross threads.
+ * Runs with 1, 2, 4, ... up to T threads and reports millions of
+ * malloc/free pairs per second, for mm_alloc with its thread caches
+ * (hw3lib.so), mm_alloc with a single lock (hw3lib_locked.so) and glibc.
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct allocator {
+  const char* name;
+  const char* library; /* NULL for the C library's malloc */
+  void* (*malloc)(size_t);
+  void (*free)(void*);
+};
+
+static struct allocator allocators[] = {
+    {"mm_alloc", "./hw3lib.so", NULL, NULL},
+    {"mm_alloc single lock", "./hw3lib_locked.so", NULL, NULL},
+    {"glibc", NULL, NULL, NULL},
+};
+
+#define NALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+static int ops = 1000000;
+static int live = 1000;
+
+struct worker {
+  pthread_t thread;
+  struct allocator* alloc;
+  unsigned seed;
+  void** blocks;
+  /* Blocks handed over by the previous thread, freed by this one */
+  void** inbox;
+  int inbox_len;
+  pthread_mutex_t inbox_lock;
+  struct worker* next;
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* load(void* handle, const char* symbol) {
+  void* function = dlsym(handle, symbol);
+  if (function == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  return function;
+}
+
+static void* new_block(struct worker* w) {
+  size_t size = 16 + rand_r(&w->seed) % 497;
+  char* p = w->alloc->malloc(size);
+  if (p == NULL) {
+    fprintf(stderr, "%s: out of memory\n", w->alloc->name);
+    exit(1);
+  }
+  p[0] = p[size - 1] = 1;
+  return p;
+}
+
+/* Passes a full inbox's worth of blocks to the next thread */
+static void hand_over(struct worker* w, void** blocks, int n) {
+  struct worker* next = w->next;
+  pthread_mutex_lock(&next->inbox_lock);
+  for (int i = 0; i < n && next->inbox_len < live; i++)
+    next->inbox[next->inbox_len++] = blocks[i];
+  pthread_mutex_unlock(&next->inbox_lock);
+}
+
+static void drain_inbox(struct worker* w) {
+  pthread_mutex_lock(&w->inbox_lock);
+  for (int i = 0; i < w->inbox_len; i++)
+    w->alloc->free(w->inbox[i]);
+  w->inbox_len = 0;
+  pthread_mutex_unlock(&w->inbox_lock);
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  bool producer = w->next != w && w->seed % 8 == 0;
+  for (int i = 0; i < live; i++)
+    w->blocks[i] = new_block(w);
+  for (int op = 0; op < ops; op++) {
+    int i = rand_r(&w->seed) % live;
+    if (producer && op % 64 == 0 && w->next->inbox_len < live / 2) {
+      hand_over(w, &w->blocks[i], 1);
+    } else {
+      w->alloc->free(w->blocks[i]);
+    }
+    w->blocks[i] = new_block(w);
+    if (op % 256 == 0)
+      drain_inbox(w);
+  }
+  for (int i = 0; i < live; i++)
+    w->alloc->free(w->blocks[i]);
+  return NULL;
+}
+
+/* Returns millions of malloc/free pairs per second with THREADS threads */
+static double run(struct allocator* alloc, int threads) {
+  struct worker* workers = calloc(threads, sizeof(struct worker));
+  for (int t = 0; t < threads; t++) {
+    workers[t].alloc = alloc;
+    workers[t].seed = t;
+    workers[t].blocks = calloc(live, sizeof(void*));
+    workers[t].inbox = calloc(live, sizeof(void*));
+    pthread_mutex_init(&workers[t].inbox_lock, NULL);
+    workers[t].next = &workers[(t + 1) % threads];
+  }
+  double t0 = now();
+  for (int t = 0; t < threads; t++)
+    pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+  for (int t = 0; t < threads; t++)
+    pthread_join(workers[t].thread, NULL);
+  double elapsed = now() - t0;
+  for (int t = 0; t < threads; t++) {
+    drain_inbox(&workers[t]);
+    free(workers[t].blocks);
+    free(workers[t].inbox);
+  }
+  free(workers);
+  return (double)threads * ops / elapsed / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:l:")) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'n':
+        ops = atoi(optarg);
+        break;
+      case 'l':
+        live = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t max_threads] [-n ops_per_thread] [-l live_blocks]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (max_threads < 1 || ops < 1 || live < 1) {
+    fprintf(stderr, "%s: bad argument\n", argv[0]);
+    return 1;
+  }
+
+  for (size_t a = 0; a < NALLOCATORS; a++) {
+    struct allocator* alloc = &allocators[a];
+    if (alloc->library == NULL) {
+      alloc->malloc = malloc;
+      alloc->free = free;
+      continue;
+    }
+    void* handle = dlopen(alloc->library, RTLD_NOW);
+    if (handle == NULL) {
+      fprintf(stderr, "%s\n", dlerror());
+      return 1;
+    }
+    alloc->malloc = load(handle, "mm_malloc");
+    alloc->free = load(handle, "mm_free");
+  }
+
+  printf("%d malloc/free pairs per thread, %d live blocks per thread; Mpairs/s\n", ops, live);
+  printf("%-8s", "threads");
+  for (size_t a = 0; a < NALLOCATORS; a++)
+    printf("%22s", allocators[a].name);
+  printf("\n");
+  for (int threads = 1;; threads = threads * 2 > max_threads ? max_threads : threads * 2) {
+    printf("%-8d", threads);
+    for (size_t a = 0; a < NALLOCATORS; a++) {
+      printf("%22.2f", run(&allocators[a], threads));
+      fflush(stdout);
+    }
+    printf("\n");
+    if (threads == max_threads)
+      break;
+  }
+  return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * mm_pool.c
+ *
+ * Pools of fixed-size objects, for structures allocated and freed so
+ * often that mm_malloc's handling of every size is wasted on them.
+ *
+ * A pool carves its objects out of slabs: blocks of at least a page,
+ * mapped straight from the system a batch at a time and aligned to their
+ * own size, so masking an object's address finds its slab. Each slab
+ * starts with a header, and links its free objects through their first
+ * word; objects never handed out yet are taken from the end of the used
+ * part instead. Slabs with free objects sit on the pool's partial list.
+ * A slab left with nothing in use is kept as the pool's spare. If there
+ * already is one, the slab's pages after its first are dropped with
+ * madvise(MADV_DONTNEED) and it waits on the released list to be used
+ * again. Slabs are never unmapped on their own, since the address range
+ * would be free for another mapping when the pool unmaps its batches.
+ *
+ * A pool may also give each thread a magazine: a small stack of free
+ * objects the thread allocates from and frees to without locking. An
+ * empty magazine is refilled, and a full one half emptied, under the
+ * pool's lock. A thread's magazine goes back to the pool when it exits.
+ */
+
+#include "mm_alloc.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* The fewest objects a slab holds */
+#define SLAB_MIN_OBJECTS 8
+
+/* Slabs are mapped this many bytes' worth at a time */
+#define SLAB_BATCH_BYTES (256 * 1024)
+
+struct slab {
+  struct slab* next; /* On the partial list */
+  struct slab* prev;
+  void* free;        /* Objects freed, linked through their first word */
+  char* unused;      /* Objects never handed out start here */
+  unsigned in_use;
+};
+
+/* A thread's cache of free objects */
+struct magazine {
+  struct mm_pool* pool;
+  struct magazine* next; /* In the pool's list of every magazine */
+  size_t allocs;
+  size_t frees;
+  unsigned count;
+  void* rounds[];
+};
+
+/* A mapping slabs were carved from */
+struct batch {
+  void* addr;
+  size_t length;
+  struct batch* next;
+};
+
+struct mm_pool {
+  pthread_mutex_t lock;
+  size_t object_size;
+  size_t slab_size;
+  size_t first_object; /* Offset of a slab's first object */
+  unsigned per_slab;
+
+  struct slab* partial;
+  struct slab* spare;
+  struct slab* released; /* Empty slabs with their pages dropped, linked through next */
+  size_t nreleased;
+  struct batch* batches;
+  char* batch_next; /* Slabs mapped and not used yet */
+  size_t batch_left;
+
+  unsigned rounds; /* Magazine size, or 0 for none */
+  pthread_key_t key;
+  struct magazine* magazines;
+
+  size_t slabs;     /* Slabs in use, and the spare */
+  size_t handed;    /* Objects handed out by slabs, to threads or magazines */
+  size_t allocs;    /* Allocations and frees not through a magazine */
+  size_t frees;
+};
+
+mm_pool_t* mm_pool_create(size_t size, size_t align) {
+  if (align == 0)
+    align = 16;
+  if ((align & (align - 1)) != 0 || size > SIZE_MAX / 2 / SLAB_MIN_OBJECTS)
+    return NULL;
+  mm_pool_t* pool = mm_malloc(sizeof(mm_pool_t));
+  if (pool == NULL)
+    return NULL;
+  memset(pool, 0, sizeof(mm_pool_t));
+  pthread_mutex_init(&pool->lock, NULL);
+
+  /* Room for the free list link, and every object aligned */
+  if (size < sizeof(void*))
+    size = sizeof(void*);
+  pool->object_size = (size + align - 1) & ~(align - 1);
+  pool->first_object = (sizeof(struct slab) + align - 1) & ~(align - 1);
+  pool->slab_size = sysconf(_SC_PAGESIZE);
+  while (pool->slab_size < align ||
+         (pool->slab_size - pool->first_object) / pool->object_size < SLAB_MIN_OBJECTS)
+    pool->slab_size *= 2;
+  pool->per_slab = (pool->slab_size - pool->first_object) / pool->object_size;
+  return pool;
+}
+
+/* Maps a batch of slabs, aligned to the slab size. With the lock held. */
+static bool map_batch(mm_pool_t* pool) {
+  struct batch* batch = mm_malloc(sizeof(struct batch));
+  if (batch == NULL)
+    return false;
+  size_t count = SLAB_BATCH_BYTES / pool->slab_size;
+  if (count == 0)
+    count = 1;
+  size_t length = count * pool->slab_size;
+  char* map = mmap(NULL, length + pool->slab_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+    mm_free(batch);
+    return false;
+  }
+  /* Trim the mapping to the aligned part */
+  char* start = (char*)(((uintptr_t)map + pool->slab_size - 1) & ~(pool->slab_size - 1));
+  if (start > map)
+    munmap(map, start - map);
+  munmap(start + length, map + pool->slab_size - start);
+
+  *batch = (struct batch){start, length, pool->batches};
+  pool->batches = batch;
+  pool->batch_next = start;
+  pool->batch_left = count;
+  return true;
+}
+
+static void partial_push(mm_pool_t* pool, struct slab* slab) {
+  slab->prev = NULL;
+  slab->next = pool->partial;
+  if (slab->next != NULL)
+    slab->next->prev = slab;
+  pool->partial = slab;
+}
+
+static void partial_remove(mm_pool_t* pool, struct slab* slab) {
+  if (slab->prev != NULL)
+    slab->prev->next = slab->next;
+  else
+    pool->partial = slab->next;
+  if (slab->next != NULL)
+    slab->next->prev = slab->prev;
+}
+
+/* A slab with nothing in use: the spare, or a new one. With the lock held. */
+static struct slab* empty_slab(mm_pool_t* pool) {
+  struct slab* slab = pool->spare;
+  if (slab != NULL) {
+    pool->spare = NULL;
+  } else if ((slab = pool->released) != NULL) {
+    pool->released = slab->next;
+    pool->nreleased--;
+    pool->slabs++;
+  } else {
+    if (pool->batch_left == 0 && !map_batch(pool))
+      return NULL;
+    slab = (struct slab*)pool->batch_next;
+    pool->batch_next += pool->slab_size;
+    pool->batch_left--;
+    pool->slabs++;
+  }
+  slab->free = NULL;
+  slab->unused = (char*)slab + pool->first_object;
+  slab->in_use = 0;
+  return slab;
+}
+
+/* Takes an object from the slabs. With the lock held. */
+static void* slab_alloc(mm_pool_t* pool) {
+  struct slab* slab = pool->partial;
+  if (slab == NULL) {
+    if ((slab = empty_slab(pool)) == NULL)
+      return NULL;
+    partial_push(pool, slab);
+  }
+  void* obj = slab->free;
+  if (obj != NULL) {
+    slab->free = *(void**)obj;
+  } else {
+    obj = slab->unused;
+    slab->unused += pool->object_size;
+  }
+  if (++slab->in_use == pool->per_slab)
+    partial_remove(pool, slab);
+  pool->handed++;
+  return obj;
+}
+
+/* Returns an object to its slab. With the lock held. */
+static void slab_free(mm_pool_t* pool, void* obj) {
+  struct slab* slab = (struct slab*)((uintptr_t)obj & ~(pool->slab_size - 1));
+  *(void**)obj = slab->free;
+  slab->free = obj;
+  pool->handed--;
+  if (slab->in_use-- == pool->per_slab)
+    partial_push(pool, slab);
+  if (slab->in_use > 0)
+    return;
+  partial_remove(pool, slab);
+  if (pool->spare == NULL) {
+    pool->spare = slab;
+    return;
+  }
+  /* The header stays, to link the slab; a slab of one page keeps it all */
+  size_t page = sysconf(_SC_PAGESIZE);
+  if (pool->slab_size > page)
+    madvise((char*)slab + page, pool->slab_size - page, MADV_DONTNEED);
+  slab->next = pool->released;
+  pool->released = slab;
+  pool->nreleased++;
+  pool->slabs--;
+}
+
+/* Magazines */
+
+/* Gives a thread's magazine back to its pool as the thread exits */
+static void magazine_release(void* arg) {
+  struct magazine* mag = arg;
+  mm_pool_t* pool = mag->pool;
+  pthread_mutex_lock(&pool->lock);
+  while (mag->count > 0)
+    slab_free(pool, mag->rounds[--mag->count]);
+  pool->allocs += mag->allocs;
+  pool->frees += mag->frees;
+  for (struct magazine** p = &pool->magazines; *p != NULL; p = &(*p)->next) {
+    if (*p == mag) {
+      *p = mag->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  mm_free(mag);
+}
+
+int mm_pool_set_magazines(mm_pool_t* pool, unsigned rounds) {
+  if (pool->rounds != 0 || pool->allocs != 0 || pool->handed != 0 || rounds == 0)
+    return -1;
+  if (pthread_key_create(&pool->key, magazine_release) != 0)
+    return -1;
+  pool->rounds = rounds;
+  return 0;
+}
+
+/* The calling thread's magazine, made if need be; NULL if there is no memory for one */
+static struct magazine* get_magazine(mm_pool_t* pool) {
+  struct magazine* mag = pthread_getspecific(pool->key);
+  if (mag != NULL)
+    return mag;
+  mag = mm_malloc(sizeof(struct magazine) + pool->rounds * sizeof(void*));
+  if (mag == NULL)
+    return NULL;
+  memset(mag, 0, sizeof(struct magazine));
+  mag->pool = pool;
+  pthread_mutex_lock(&pool->lock);
+  mag->next = pool->magazines;
+  pool->magazines = mag;
+  pthread_mutex_unlock(&pool->lock);
+  pthread_setspecific(pool->key, mag);
+  return mag;
+}
+
+void* mm_pool_alloc(mm_pool_t* pool) {
+  struct magazine* mag = pool->rounds != 0 ? get_magazine(pool) : NULL;
+  if (mag != NULL) {
+    if (mag->count == 0) {
+      pthread_mutex_lock(&pool->lock);
+      void* obj;
+      while (mag->count < (pool->rounds + 1) / 2 && (obj = slab_alloc(pool)) != NULL)
+        mag->rounds[mag->count++] = obj;
+      pthread_mutex_unlock(&pool->lock);
+      if (mag->count == 0)
+        return NULL;
+    }
+    mag->allocs++;
+    return mag->rounds[--mag->count];
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  void* obj = slab_alloc(pool);
+  if (obj != NULL)
+    pool->allocs++;
+  pthread_mutex_unlock(&pool->lock);
+  return obj;
+}
+
+void mm_pool_free(mm_pool_t* pool, void* obj) {
+  if (obj == NULL)
+    return;
+  struct magazine* mag = pool->rounds != 0 ? get_magazine(pool) : NULL;
+  if (mag != NULL) {
+    if (mag->count == pool->rounds) {
+      pthread_mutex_lock(&pool->lock);
+      while (mag->count > pool->rounds / 2)
+        slab_free(pool, mag->rounds[--mag->count]);
+      pthread_mutex_unlock(&pool->lock);
+    }
+    mag->frees++;
+    mag->rounds[mag->count++] = obj;
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  slab_free(pool, obj);
+  pool->frees++;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void mm_pool_stats(mm_pool_t* pool, struct mm_pool_stats* stats) {
+  pthread_mutex_lock(&pool->lock);
+  *stats = (struct mm_pool_stats){
+      .object_size = pool->object_size,
+      .slab_size = pool->slab_size,
+      .slabs = pool->slabs,
+      .mapped = (pool->slabs + pool->nreleased + pool->batch_left) * pool->slab_size,
+      .allocs = pool->allocs,
+      .frees = pool->frees,
+  };
+  /* Other threads' counts may be a little behind */
+  for (struct magazine* mag = pool->magazines; mag != NULL; mag = mag->next) {
+    stats->cached += mag->count;
+    stats->allocs += mag->allocs;
+    stats->frees += mag->frees;
+  }
+  stats->in_use = pool->handed - stats->cached;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void mm_pool_destroy(mm_pool_t* pool) {
+  if (pool == NULL)
+    return;
+  if (pool->rounds != 0) {
+    pthread_key_delete(pool->key);
+    while (pool->magazines != NULL) {
+      struct magazine* mag = pool->magazines;
+      pool->magazines = mag->next;
+      mm_free(mag);
+    }
+  }
+  while (pool->batches != NULL) {
+    struct batch* batch = pool->batches;
+    pool->batches = batch->next;
+    munmap(batch->addr, batch->length);
+    mm_free(batch);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  mm_free(pool);
+}
@@ -0,0 +1,257 @@
+/*
+ * mm_profile.c
+ *
+ * A sampling heap profiler for mm_alloc.
+ *
+ * Each thread counts down the bytes it allocates, and the allocation that
+ * takes the count past zero is sampled: its backtrace is taken and the
+ * block is charged to that call site until it is freed. The distance to
+ * the next sample is drawn from an exponential distribution with a mean
+ * of the sampling interval, so every byte is equally likely to be sampled
+ * and pprof can scale the samples back up to estimates of the whole heap.
+ *
+ * Sampling is off unless MM_PROFILE is set to the sampling interval in
+ * bytes, or mm_profile_start() is called. With it on, a profile of the
+ * sampled blocks still live is written when the program exits, in the heap
+ * profile format of gperftools that pprof reads, to
+ * MM_PROFILE_FILE.<pid>.<nnnn>.heap (by default mm_alloc.<pid>.<nnnn>.heap),
+ * where <nnnn> counts the profiles written from 0001, as gperftools does.
+ * Started by MM_PROFILE, it is also written at the first allocation or
+ * free after each SIGUSR2. With sampling off, an allocation pays for one
+ * test of a flag.
+ */
+
+#define _GNU_SOURCE
+#include "mm_profile.h"
+#include "mm_alloc.h"
+
+#include <execinfo.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Frames of a backtrace kept per site */
+#define MAX_DEPTH 32
+
+/* Frames at the top of a backtrace that are the allocator's own: mm_profile_record(), the
+   allocator's sampling hook and the mm_malloc() or mm_realloc() that called it */
+#define SKIP_FRAMES 3
+
+#define SITE_BUCKETS 4096
+#define SAMPLE_BUCKETS 16384
+
+/* An allocation site, by its backtrace */
+struct site {
+  uint64_t hash;
+  int depth;
+  void* pcs[MAX_DEPTH];
+  size_t live_count;
+  size_t live_bytes;
+  size_t total_count;
+  size_t total_bytes;
+  struct site* next;
+};
+
+/* A sampled block that is still live */
+struct sample {
+  void* ptr;
+  size_t size;
+  struct site* site;
+  struct sample* next;
+};
+
+bool mm_profile_enabled;
+
+static size_t interval;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct site* sites[SITE_BUCKETS];
+static struct sample* samples[SAMPLE_BUCKETS];
+
+static const char* dump_prefix = "mm_alloc";
+static int dumps;
+static volatile sig_atomic_t dump_requested;
+
+static __thread struct {
+  long left; /* Bytes to go until the next sample, or 0 before the first */
+  uint64_t rng;
+} sampler;
+
+/* A distance to the next sample, exponentially distributed around the interval */
+static long next_interval(void) {
+  if (sampler.rng == 0)
+    sampler.rng = ((uintptr_t)&sampler ^ (uint64_t)time(NULL) * 0x9e3779b97f4a7c15ULL) | 1;
+  sampler.rng ^= sampler.rng << 13;
+  sampler.rng ^= sampler.rng >> 7;
+  sampler.rng ^= sampler.rng << 17;
+  double u = ((sampler.rng >> 11) + 1) * 0x1p-53;
+  return (long)(-log(u) * interval) + 1;
+}
+
+bool mm_profile_sample(size_t size) {
+  if (sampler.left == 0)
+    sampler.left = next_interval();
+  sampler.left -= (long)size;
+  if (sampler.left > 0)
+    return false;
+  sampler.left = next_interval();
+  return true;
+}
+
+static size_t sample_bucket(void* ptr) {
+  return ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL >> 50 & (SAMPLE_BUCKETS - 1);
+}
+
+/* The site with backtrace PCS, made if need be. With the lock held. */
+static struct site* find_site(void** pcs, int depth) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < depth; i++)
+    hash = (hash ^ (uintptr_t)pcs[i]) * 1099511628211ULL;
+  struct site** bucket = &sites[hash % SITE_BUCKETS];
+  for (struct site* site = *bucket; site != NULL; site = site->next)
+    if (site->hash == hash && site->depth == depth &&
+        memcmp(site->pcs, pcs, depth * sizeof(void*)) == 0)
+      return site;
+  struct site* site = calloc(1, sizeof(struct site));
+  if (site == NULL)
+    return NULL;
+  site->hash = hash;
+  site->depth = depth;
+  memcpy(site->pcs, pcs, depth * sizeof(void*));
+  site->next = *bucket;
+  *bucket = site;
+  return site;
+}
+
+void mm_profile_record(void* ptr, size_t size) {
+  void* pcs[MAX_DEPTH + SKIP_FRAMES];
+  int depth = backtrace(pcs, MAX_DEPTH + SKIP_FRAMES) - SKIP_FRAMES;
+  if (depth < 0)
+    depth = 0;
+  struct sample* sample = malloc(sizeof(struct sample));
+  if (sample == NULL)
+    return;
+
+  pthread_mutex_lock(&profile_lock);
+  struct site* site = find_site(pcs + SKIP_FRAMES, depth);
+  if (site == NULL) {
+    pthread_mutex_unlock(&profile_lock);
+    free(sample);
+    return;
+  }
+  site->live_count++;
+  site->live_bytes += size;
+  site->total_count++;
+  site->total_bytes += size;
+  *sample = (struct sample){ptr, size, site, samples[sample_bucket(ptr)]};
+  samples[sample_bucket(ptr)] = sample;
+  pthread_mutex_unlock(&profile_lock);
+}
+
+void mm_profile_forget(void* ptr) {
+  pthread_mutex_lock(&profile_lock);
+  for (struct sample** p = &samples[sample_bucket(ptr)]; *p != NULL; p = &(*p)->next) {
+    struct sample* sample = *p;
+    if (sample->ptr == ptr) {
+      sample->site->live_count--;
+      sample->site->live_bytes -= sample->size;
+      *p = sample->next;
+      free(sample);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&profile_lock);
+}
+
+int mm_profile_dump(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (out == NULL)
+    return -1;
+  pthread_mutex_lock(&profile_lock);
+  size_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+  for (int b = 0; b < SITE_BUCKETS; b++) {
+    for (struct site* site = sites[b]; site != NULL; site = site->next) {
+      live_count += site->live_count;
+      live_bytes += site->live_bytes;
+      total_count += site->total_count;
+      total_bytes += site->total_bytes;
+    }
+  }
+  fprintf(out, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", live_count, live_bytes,
+          total_count, total_bytes, interval);
+  for (int b = 0; b < SITE_BUCKETS; b++) {
+    for (struct site* site = sites[b]; site != NULL; site = site->next) {
+      fprintf(out, "%zu: %zu [%zu: %zu] @", site->live_count, site->live_bytes,
+              site->total_count, site->total_bytes);
+      for (int i = 0; i < site->depth; i++)
+        fprintf(out, " %p", site->pcs[i]);
+      fputc('\n', out);
+    }
+  }
+  pthread_mutex_unlock(&profile_lock);
+
+  /* pprof maps the addresses back to code with these */
+  fputs("\nMAPPED_LIBRARIES:\n", out);
+  FILE* maps = fopen("/proc/self/maps", "r");
+  if (maps != NULL) {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), maps)) > 0)
+      fwrite(buf, 1, n, out);
+    fclose(maps);
+  }
+  return fclose(out) == 0 ? 0 : -1;
+}
+
+/* Writes the next numbered profile */
+static void dump_next(void) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.%d.%04d.heap", dump_prefix, (int)getpid(), ++dumps);
+  if (mm_profile_dump(path) < 0)
+    perror(path);
+}
+
+void mm_profile_poll(void) {
+  if (dump_requested) {
+    dump_requested = 0;
+    dump_next();
+  }
+}
+
+static void request_dump(int signo) {
+  (void)signo;
+  dump_requested = 1;
+}
+
+static void dump_at_exit(void) {
+  if (mm_profile_enabled)
+    dump_next();
+}
+
+void mm_profile_start(size_t sample_bytes) {
+  static bool registered;
+  interval = sample_bytes;
+  mm_profile_enabled = sample_bytes > 0;
+  if (mm_profile_enabled && !registered) {
+    registered = true;
+    atexit(dump_at_exit);
+  }
+}
+
+/* Starts profiling at load time if MM_PROFILE asks for it */
+__attribute__((constructor)) static void profile_init(void) {
+  const char* bytes = getenv("MM_PROFILE");
+  if (bytes == NULL || atol(bytes) <= 0)
+    return;
+  const char* prefix = getenv("MM_PROFILE_FILE");
+  if (prefix != NULL && *prefix != '\0')
+    dump_prefix = prefix;
+  struct sigaction action = {.sa_handler = request_dump, .sa_flags = SA_RESTART};
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR2, &action, NULL);
+  mm_profile_start(atol(bytes));
+}
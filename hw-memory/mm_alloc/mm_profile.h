@@ -0,0 +1,27 @@
+/*
+ * mm_profile.h
+ *
+ * The sampling heap profiler's side of mm_alloc. The allocator asks it
+ * whether to sample each allocation, and tells it when a sampled block
+ * is freed.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Whether sampling is on; the allocator checks this before anything else here */
+extern bool mm_profile_enabled;
+
+/* Whether to sample an allocation of SIZE bytes, counting it toward the next sample */
+bool mm_profile_sample(size_t size);
+
+/* Records sampled block PTR of SIZE bytes, allocated by the caller's caller's caller */
+void mm_profile_record(void* ptr, size_t size);
+
+/* Forgets sampled block PTR, which is being freed */
+void mm_profile_forget(void* ptr);
+
+/* Writes the profile if a signal has asked for one */
+void mm_profile_poll(void);
@@ -0,0 +1,532 @@
+/*
+ * Replay allocation traces against mm_alloc and glibc.
+ *
+ * Usage: mm_replay [-l library] [trace...]
+ *
+ * Plays back each trace, as recorded by mm_trace.so, and a few synthetic
+ * workloads, with mm_alloc (hw3lib.so, or the library given with -l) and
+ * with glibc. With no traces named, plays back every traces/ *.trace.
+ * Each run happens in a fresh child process, so the heaps start empty.
+ * For each run it reports
+ *
+ *   Mops/s     operations per second, untimed
+ *   peak KB    the most memory the process held beyond its starting point
+ *   util       the most bytes live at once, over peak KB
+ *   p50 ...    latency of single operations, in nanoseconds
+ *
+ * Latencies come from a second run with a clock read around every
+ * operation, which also samples the memory held after each tenth of the
+ * trace, for a second table of how it rises and falls. Every page of a block is written once, so that peak KB counts
+ * the memory the allocator handed out, not just what it reserved.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct allocator {
+  const char* name;
+  void* (*malloc)(size_t);
+  void* (*realloc)(void*, size_t);
+  void (*free)(void*);
+};
+
+/* One operation on the block numbered ID */
+struct op {
+  char type; /* 'm', 'r' or 'f' */
+  int id;
+  size_t size;
+};
+
+struct trace {
+  char* name;
+  struct op* ops;
+  int nops;
+  int nids;
+  size_t peak_live; /* The most bytes requested and not yet freed at once */
+};
+
+/* Points in a run where the memory held is sampled: the start of each tenth, and the end */
+#define RSS_POINTS 11
+
+struct result {
+  double mops;
+  long peak_kb;
+  uint32_t p50, p90, p99, p999, max;
+  long rss_kb[RSS_POINTS];
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Trace building */
+
+static void add_op(struct trace* trace, int* cap, char type, int id, size_t size) {
+  if (trace->nops == *cap) {
+    *cap = *cap ? *cap * 2 : 1024;
+    trace->ops = realloc(trace->ops, *cap * sizeof(struct op));
+  }
+  trace->ops[trace->nops++] = (struct op){type, id, size};
+  if (id >= trace->nids)
+    trace->nids = id + 1;
+}
+
+/* Fills in TRACE's peak live bytes */
+static void measure_live(struct trace* trace) {
+  size_t* sizes = calloc(trace->nids, sizeof(size_t));
+  size_t live = 0;
+  for (int i = 0; i < trace->nops; i++) {
+    struct op* op = &trace->ops[i];
+    live -= sizes[op->id];
+    sizes[op->id] = op->type == 'f' ? 0 : op->size;
+    live += sizes[op->id];
+    if (live > trace->peak_live)
+      trace->peak_live = live;
+  }
+  free(sizes);
+}
+
+/* Maps the pointers of a recorded trace to block numbers, reusing the numbers of freed
+   blocks. An open-addressing table; freed entries stay as tombstones. */
+struct id_map {
+  uintptr_t* keys; /* 0 for empty */
+  int* ids;        /* -1 for a tombstone */
+  size_t mask;
+  int* free_ids;
+  int nfree;
+  int next_id;
+};
+
+static size_t id_slot(struct id_map* map, uintptr_t key) {
+  size_t i = (key >> 4) * 0x9e3779b97f4a7c15ULL & map->mask;
+  while (map->keys[i] != 0 && (map->keys[i] != key || map->ids[i] < 0))
+    i = (i + 1) & map->mask;
+  return i;
+}
+
+static void id_put(struct id_map* map, uintptr_t key, int id) {
+  size_t i = id_slot(map, key);
+  map->keys[i] = key;
+  map->ids[i] = id;
+}
+
+/* Gives KEY a block number, reusing a freed one if there is one */
+static int id_add(struct id_map* map, uintptr_t key) {
+  int id = map->nfree > 0 ? map->free_ids[--map->nfree] : map->next_id++;
+  id_put(map, key, id);
+  return id;
+}
+
+/* Returns the block number of KEY and forgets KEY, or -1 if it is not known */
+static int id_take(struct id_map* map, uintptr_t key) {
+  size_t i = id_slot(map, key);
+  if (map->keys[i] == 0)
+    return -1;
+  int id = map->ids[i];
+  map->ids[i] = -1;
+  return id;
+}
+
+static struct trace* load_trace(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(1);
+  }
+  size_t lines = 0;
+  for (int c; (c = getc(file)) != EOF;)
+    lines += c == '\n';
+  rewind(file);
+
+  struct id_map map = {0};
+  size_t slots = 16;
+  while (slots < 2 * lines)
+    slots *= 2;
+  map.keys = calloc(slots, sizeof(uintptr_t));
+  map.ids = calloc(slots, sizeof(int));
+  map.free_ids = calloc(lines + 1, sizeof(int));
+  map.mask = slots - 1;
+
+  struct trace* trace = calloc(1, sizeof(struct trace));
+  const char* base = strrchr(path, '/');
+  trace->name = strdup(base ? base + 1 : path);
+  char* dot = strrchr(trace->name, '.');
+  if (dot != NULL)
+    *dot = '\0';
+  int cap = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    size_t size;
+    void *old, *ptr;
+    int id;
+    if (sscanf(line, "m %zu %p", &size, &ptr) == 2) {
+      add_op(trace, &cap, 'm', id_add(&map, (uintptr_t)ptr), size);
+    } else if (sscanf(line, "r %p %zu %p", &old, &size, &ptr) == 3) {
+      id = old == NULL ? -1 : id_take(&map, (uintptr_t)old);
+      if (size == 0 && id >= 0) {
+        map.free_ids[map.nfree++] = id;
+        add_op(trace, &cap, 'f', id, 0);
+      } else if (size > 0 && id < 0) {
+        add_op(trace, &cap, 'm', id_add(&map, (uintptr_t)ptr), size);
+      } else if (size > 0) {
+        /* The block keeps its number, so the replay resizes the same block */
+        id_put(&map, (uintptr_t)ptr, id);
+        add_op(trace, &cap, 'r', id, size);
+      }
+    } else if (sscanf(line, "f %p", &ptr) == 1) {
+      /* Blocks from before recording began are not known */
+      if ((id = id_take(&map, (uintptr_t)ptr)) >= 0) {
+        map.free_ids[map.nfree++] = id;
+        add_op(trace, &cap, 'f', id, 0);
+      }
+    }
+  }
+  fclose(file);
+  free(map.keys);
+  free(map.ids);
+  free(map.free_ids);
+  measure_live(trace);
+  return trace;
+}
+
+/* Synthetic traces */
+
+static size_t mixed_size(void) {
+  int kind = rand() % 100;
+  if (kind < 80)
+    return 1 + rand() % 512;
+  if (kind < 98)
+    return 1024 + rand() % (64 * 1024);
+  return 256 * 1024 + rand() % (1024 * 1024);
+}
+
+/* Random mallocs, reallocs and frees of mixed sizes over 1000 live blocks */
+static void synth_random(struct trace* trace, int* cap) {
+  enum { SLOTS = 1000 };
+  char live[SLOTS] = {0};
+  for (int i = 0; i < 200000; i++) {
+    int id = rand() % SLOTS;
+    if (!live[id])
+      add_op(trace, cap, 'm', id, mixed_size());
+    else if (rand() % 3 == 0)
+      add_op(trace, cap, 'r', id, mixed_size());
+    else
+      add_op(trace, cap, 'f', id, 0);
+    live[id] = trace->ops[trace->nops - 1].type != 'f';
+  }
+}
+
+/* A server's day: three bursts that each build up some 64 MB and free all but one block in
+   twenty, each followed by a quiet spell of small requests coming and going */
+static void synth_phases(struct trace* trace, int* cap) {
+  enum { BURST = 4000, QUIET = 100 };
+  int next_id = QUIET;
+  char quiet[QUIET] = {0};
+  for (int phase = 0; phase < 3; phase++) {
+    int first = next_id;
+    for (int i = 0; i < BURST; i++)
+      add_op(trace, cap, 'm', next_id++, 1024 + rand() % (31 * 1024));
+    for (int id = first; id < next_id; id++)
+      if ((id - first) % 20 != 0)
+        add_op(trace, cap, 'f', id, 0);
+    for (int i = 0; i < 20000; i++) {
+      int id = rand() % QUIET;
+      add_op(trace, cap, quiet[id] ? 'f' : 'm', id, 16 + rand() % 240);
+      quiet[id] = !quiet[id];
+    }
+  }
+}
+
+/* Allocates 50000 small blocks, then frees them in random order */
+static void synth_ramp(struct trace* trace, int* cap) {
+  enum { BLOCKS = 50000 };
+  int* order = malloc(BLOCKS * sizeof(int));
+  for (int id = 0; id < BLOCKS; id++) {
+    add_op(trace, cap, 'm', id, 8 + rand() % 256);
+    order[id] = id;
+  }
+  for (int i = BLOCKS - 1; i > 0; i--) {
+    int j = rand() % (i + 1), t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for (int i = 0; i < BLOCKS; i++)
+    add_op(trace, cap, 'f', order[i], 0);
+  free(order);
+}
+
+/* Interleaves small and larger blocks, frees the larger ones and asks for slightly larger
+   ones still, which the holes between the small blocks cannot serve */
+static void synth_binary(struct trace* trace, int* cap) {
+  enum { PAIRS = 4000 };
+  for (int i = 0; i < PAIRS; i++) {
+    add_op(trace, cap, 'm', 2 * i, 64);
+    add_op(trace, cap, 'm', 2 * i + 1, 448);
+  }
+  for (int i = 0; i < PAIRS; i++)
+    add_op(trace, cap, 'f', 2 * i + 1, 0);
+  for (int i = 0; i < PAIRS; i++)
+    add_op(trace, cap, 'm', 2 * PAIRS + i, 512);
+  for (int id = 0; id < 3 * PAIRS; id++)
+    if (id >= 2 * PAIRS || id % 2 == 0)
+      add_op(trace, cap, 'f', id, 0);
+}
+
+/* 100 buffers grown a little at a time, with small allocations coming and going between */
+static void synth_realloc(struct trace* trace, int* cap) {
+  enum { BUFFERS = 100, SMALL = 100 };
+  size_t sizes[BUFFERS] = {0};
+  char small[SMALL] = {0};
+  for (int i = 0; i < 100000; i++) {
+    int b = rand() % BUFFERS;
+    sizes[b] += 1 + rand() % 256;
+    add_op(trace, cap, sizes[b] > 256 ? 'r' : 'm', b, sizes[b]);
+    if (sizes[b] <= 256)
+      sizes[b] = 257;
+    int s = rand() % SMALL;
+    add_op(trace, cap, small[s] ? 'f' : 'm', BUFFERS + s, 16 + rand() % 112);
+    small[s] = !small[s];
+  }
+}
+
+static struct trace* synthesize(const char* name, void (*generate)(struct trace*, int*)) {
+  struct trace* trace = calloc(1, sizeof(struct trace));
+  trace->name = strdup(name);
+  int cap = 0;
+  srand(1);
+  generate(trace, &cap);
+  measure_live(trace);
+  return trace;
+}
+
+/* Replaying */
+
+static long status_kb(const char* field) {
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file == NULL)
+    return 0;
+  char line[256];
+  long kb = 0;
+  size_t len = strlen(field);
+  while (fgets(line, sizeof(line), file) != NULL)
+    if (strncmp(line, field, len) == 0)
+      kb = atol(line + len + 1);
+  fclose(file);
+  return kb;
+}
+
+static void touch(char* p, size_t from, size_t size) {
+  if (p == NULL)
+    return;
+  for (size_t i = from; i < size; i += 4096)
+    p[i] = 1;
+  if (size > from)
+    p[size - 1] = 1;
+}
+
+static int compare_u32(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+/* Plays TRACE back once. If LATENCIES is not NULL, times each operation into it and samples
+   the memory held beyond START_KB into RSS. */
+static void replay(struct allocator* alloc, struct trace* trace, uint32_t* latencies,
+                   long* rss, long start_kb) {
+  char** blocks = calloc(trace->nids, sizeof(char*));
+  size_t* sizes = calloc(trace->nids, sizeof(size_t));
+  struct timespec t0, t1;
+  int point = 0;
+  for (int i = 0; i < trace->nops; i++) {
+    struct op* op = &trace->ops[i];
+    if (latencies && i == (long)trace->nops * point / (RSS_POINTS - 1))
+      rss[point++] = status_kb("VmRSS:") - start_kb;
+    if (latencies)
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+    switch (op->type) {
+      case 'm':
+        blocks[op->id] = alloc->malloc(op->size);
+        break;
+      case 'r':
+        blocks[op->id] = alloc->realloc(blocks[op->id], op->size);
+        break;
+      case 'f':
+        alloc->free(blocks[op->id]);
+        blocks[op->id] = NULL;
+        break;
+    }
+    if (latencies) {
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      latencies[i] = (t1.tv_sec - t0.tv_sec) * 1000000000L + t1.tv_nsec - t0.tv_nsec;
+    }
+    if (op->type != 'f') {
+      touch(blocks[op->id], op->type == 'r' && op->size > sizes[op->id] ? sizes[op->id] : 0,
+            op->size);
+      sizes[op->id] = op->size;
+    }
+  }
+  if (latencies)
+    rss[RSS_POINTS - 1] = status_kb("VmRSS:") - start_kb;
+}
+
+/* Replays TRACE in two child processes, one untimed and one timing each operation */
+static struct result measure(struct allocator* alloc, struct trace* trace) {
+  struct result result = {0};
+  for (int timed = 0; timed <= 1; timed++) {
+    int fds[2];
+    if (pipe(fds) < 0) {
+      perror("pipe");
+      exit(1);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      uint32_t* latencies = NULL;
+      if (timed) {
+        latencies = malloc(trace->nops * sizeof(uint32_t));
+        memset(latencies, 0, trace->nops * sizeof(uint32_t));
+      }
+      /* Hand back what loading the traces left free in glibc's heap, then reset the peak
+         to what the process holds now */
+      malloc_trim(0);
+      int clear = open("/proc/self/clear_refs", O_WRONLY);
+      if (clear >= 0) {
+        if (write(clear, "5", 1) < 0)
+          perror("clear_refs");
+        close(clear);
+      }
+      long start_kb = status_kb("VmRSS:");
+      double t0 = now();
+      replay(alloc, trace, latencies, result.rss_kb, start_kb);
+      double elapsed = now() - t0;
+      if (!timed) {
+        result.mops = trace->nops / elapsed / 1e6;
+        result.peak_kb = status_kb("VmHWM:") - start_kb;
+      } else if (trace->nops > 0) {
+        qsort(latencies, trace->nops, sizeof(uint32_t), compare_u32);
+        result.p50 = latencies[trace->nops / 2];
+        result.p90 = latencies[(long)trace->nops * 90 / 100];
+        result.p99 = latencies[(long)trace->nops * 99 / 100];
+        result.p999 = latencies[(long)trace->nops * 999 / 1000];
+        result.max = latencies[trace->nops - 1];
+      }
+      if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+        _exit(1);
+      _exit(0);
+    }
+    close(fds[1]);
+    struct result part;
+    ssize_t n = read(fds[0], &part, sizeof(part));
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (n != sizeof(part) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s: replay of %s failed\n", alloc->name, trace->name);
+      exit(1);
+    }
+    if (!timed) {
+      result.mops = part.mops;
+      result.peak_kb = part.peak_kb;
+    } else {
+      part.mops = result.mops;
+      part.peak_kb = result.peak_kb;
+      result = part;
+    }
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  const char* library = "./hw3lib.so";
+  int opt;
+  while ((opt = getopt(argc, argv, "l:")) != -1) {
+    switch (opt) {
+      case 'l':
+        library = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-l library] [trace...]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  void* handle = dlopen(library, RTLD_NOW);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 1;
+  }
+  struct allocator allocators[] = {
+      {"mm_alloc", dlsym(handle, "mm_malloc"), dlsym(handle, "mm_realloc"),
+       dlsym(handle, "mm_free")},
+      {"glibc", malloc, realloc, free},
+  };
+  if (!allocators[0].malloc || !allocators[0].realloc || !allocators[0].free) {
+    fprintf(stderr, "%s: missing mm_malloc, mm_realloc or mm_free\n", library);
+    return 1;
+  }
+
+  struct trace* traces[64];
+  int ntraces = 0;
+  if (optind < argc) {
+    for (int i = optind; i < argc && ntraces < 64; i++)
+      traces[ntraces++] = load_trace(argv[i]);
+  } else {
+    glob_t files;
+    if (glob("traces/*.trace", 0, NULL, &files) == 0) {
+      for (size_t i = 0; i < files.gl_pathc && ntraces < 60; i++)
+        traces[ntraces++] = load_trace(files.gl_pathv[i]);
+      globfree(&files);
+    }
+    traces[ntraces++] = synthesize("synth-random", synth_random);
+    traces[ntraces++] = synthesize("synth-ramp", synth_ramp);
+    traces[ntraces++] = synthesize("synth-binary", synth_binary);
+    traces[ntraces++] = synthesize("synth-realloc", synth_realloc);
+    traces[ntraces++] = synthesize("synth-phases", synth_phases);
+  }
+
+  size_t nallocators = sizeof(allocators) / sizeof(allocators[0]);
+  struct result* results = calloc(ntraces * nallocators, sizeof(struct result));
+  printf("%-14s %-9s %8s %8s %9s %6s %6s %6s %6s %7s %8s\n", "trace", "allocator", "ops",
+         "Mops/s", "peak KB", "util", "p50", "p90", "p99", "p99.9", "max");
+  for (int t = 0; t < ntraces; t++) {
+    for (size_t a = 0; a < nallocators; a++) {
+      struct result* r = &results[t * nallocators + a];
+      *r = measure(&allocators[a], traces[t]);
+      long live_kb = traces[t]->peak_live / 1024;
+      printf("%-14s %-9s %8d %8.2f %9ld %5.0f%% %6u %6u %6u %7u %8u\n", traces[t]->name,
+             allocators[a].name, traces[t]->nops, r->mops, r->peak_kb,
+             r->peak_kb > 0 ? 100.0 * live_kb / r->peak_kb : 0.0, r->p50, r->p90, r->p99,
+             r->p999, r->max);
+      fflush(stdout);
+    }
+  }
+
+  printf("\n%-14s %-9s  memory held in MB, at the start of each tenth of the trace and the end\n",
+         "trace", "allocator");
+  for (int t = 0; t < ntraces; t++) {
+    for (size_t a = 0; a < nallocators; a++) {
+      printf("%-14s %-9s", traces[t]->name, allocators[a].name);
+      for (int i = 0; i < RSS_POINTS; i++)
+        printf(" %6.1f", results[t * nallocators + a].rss_kb[i] / 1024.0);
+      printf("\n");
+    }
+  }
+  return 0;
+}
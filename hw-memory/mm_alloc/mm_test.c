@@ -1,12 +1,31 @@
 #include <assert.h>
 #include <dlfcn.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 /* Function pointers to hw3 functions */
 void* (*mm_malloc)(size_t);
 void* (*mm_realloc)(void*, size_t);
 void (*mm_free)(void*);
+int (*mm_trim)(size_t);
+void (*mm_profile_start)(size_t);
+int (*mm_profile_dump)(const char*);
+
+/* The pool interface, declared here as the functions above are */
+typedef struct mm_pool mm_pool_t;
+struct mm_pool_stats {
+  size_t object_size, slab_size, slabs, mapped, in_use, cached, allocs, frees;
+};
+mm_pool_t* (*mm_pool_create)(size_t, size_t);
+int (*mm_pool_set_magazines)(mm_pool_t*, unsigned);
+void* (*mm_pool_alloc)(mm_pool_t*);
+void (*mm_pool_free)(mm_pool_t*, void*);
+void (*mm_pool_stats)(mm_pool_t*, struct mm_pool_stats*);
+void (*mm_pool_destroy)(mm_pool_t*);
 
 static void* try_dlsym(void* handle, const char* symbol) {
   char* error;
@@ -28,6 +47,322 @@ static void load_alloc_functions() {
   mm_malloc = try_dlsym(handle, "mm_malloc");
   mm_realloc = try_dlsym(handle, "mm_realloc");
   mm_free = try_dlsym(handle, "mm_free");
+  mm_trim = try_dlsym(handle, "mm_trim");
+  mm_profile_start = try_dlsym(handle, "mm_profile_start");
+  mm_profile_dump = try_dlsym(handle, "mm_profile_dump");
+  mm_pool_create = try_dlsym(handle, "mm_pool_create");
+  mm_pool_set_magazines = try_dlsym(handle, "mm_pool_set_magazines");
+  mm_pool_alloc = try_dlsym(handle, "mm_pool_alloc");
+  mm_pool_free = try_dlsym(handle, "mm_pool_free");
+  mm_pool_stats = try_dlsym(handle, "mm_pool_stats");
+  mm_pool_destroy = try_dlsym(handle, "mm_pool_destroy");
+}
+
+/* A request size: mostly small, some in the large bins, a few mapped on their own */
+static size_t random_size(void) {
+  int kind = rand() % 100;
+  if (kind < 80)
+    return 1 + rand() % 512;
+  if (kind < 98)
+    return 1024 + rand() % (64 * 1024);
+  return 256 * 1024 + rand() % (1024 * 1024);
+}
+
+static void fill(unsigned char* p, size_t size, unsigned char tag) {
+  for (size_t i = 0; i < size; i++)
+    p[i] = tag + i;
+}
+
+static void check(unsigned char* p, size_t size, unsigned char tag) {
+  for (size_t i = 0; i < size; i++)
+    assert(p[i] == (unsigned char)(tag + i));
+}
+
+/* Random mallocs, reallocs and frees over SLOTS live blocks. Every block is filled with a
+   pattern of its own and checked before it is resized or freed, so blocks that overlap or
+   lose their contents are caught. */
+static void stress_test(int ops, int slots) {
+  unsigned char** blocks = calloc(slots, sizeof(*blocks));
+  size_t* sizes = calloc(slots, sizeof(*sizes));
+  for (int op = 0; op < ops; op++) {
+    int i = rand() % slots;
+    unsigned char tag = i * 7;
+    if (blocks[i] == NULL) {
+      sizes[i] = random_size();
+      blocks[i] = mm_malloc(sizes[i]);
+      assert(blocks[i] != NULL);
+      assert((uintptr_t)blocks[i] % 16 == 0);
+      fill(blocks[i], sizes[i], tag);
+    } else if (rand() % 3 == 0) {
+      size_t size = random_size();
+      check(blocks[i], sizes[i], tag);
+      blocks[i] = mm_realloc(blocks[i], size);
+      assert(blocks[i] != NULL);
+      assert((uintptr_t)blocks[i] % 16 == 0);
+      check(blocks[i], size < sizes[i] ? size : sizes[i], tag);
+      sizes[i] = size;
+      fill(blocks[i], sizes[i], tag);
+    } else {
+      check(blocks[i], sizes[i], tag);
+      mm_free(blocks[i]);
+      blocks[i] = NULL;
+    }
+  }
+  for (int i = 0; i < slots; i++) {
+    if (blocks[i] != NULL) {
+      check(blocks[i], sizes[i], i * 7);
+      mm_free(blocks[i]);
+    }
+  }
+  free(blocks);
+  free(sizes);
+}
+
+#define SHARED_SLOTS 256
+#define THREADS 4
+
+/* Blocks any thread may take, check and free. Each starts with its size. */
+static unsigned char* shared[SHARED_SLOTS];
+
+static void check_shared(unsigned char* p) {
+  size_t size;
+  memcpy(&size, p, sizeof(size));
+  check(p + sizeof(size), size - sizeof(size), (unsigned char)size);
+}
+
+static void* thread_main(void* arg) {
+  unsigned seed = (uintptr_t)arg;
+  for (int op = 0; op < 50000; op++) {
+    int i = rand_r(&seed) % SHARED_SLOTS;
+    unsigned char* p = __atomic_exchange_n(&shared[i], NULL, __ATOMIC_ACQ_REL);
+    if (p != NULL) {
+      check_shared(p);
+      mm_free(p);
+      continue;
+    }
+    size_t size = sizeof(size_t) + (rand_r(&seed) % 50 ? rand_r(&seed) % 1024 : rand_r(&seed) % 65536);
+    p = mm_malloc(size);
+    assert(p != NULL);
+    assert((uintptr_t)p % 16 == 0);
+    memcpy(p, &size, sizeof(size));
+    fill(p + sizeof(size), size - sizeof(size), (unsigned char)size);
+    p = __atomic_exchange_n(&shared[i], p, __ATOMIC_ACQ_REL);
+    if (p != NULL) {
+      check_shared(p);
+      mm_free(p);
+    }
+  }
+  return NULL;
+}
+
+/* Threads allocating blocks that other threads free, through every thread's cache */
+static void thread_test(void) {
+  pthread_t threads[THREADS];
+  for (uintptr_t t = 0; t < THREADS; t++)
+    assert(pthread_create(&threads[t], NULL, thread_main, (void*)(t + 1)) == 0);
+  for (int t = 0; t < THREADS; t++)
+    pthread_join(threads[t], NULL);
+  for (int i = 0; i < SHARED_SLOTS; i++) {
+    if (shared[i] != NULL) {
+      check_shared(shared[i]);
+      mm_free(shared[i]);
+    }
+  }
+}
+
+#define POOL_OBJECTS 20000
+#define POOL_SIZE 40
+
+static mm_pool_t* shared_pool;
+
+/* Allocates objects from the shared pool, checks them, and frees every other one */
+static void* pool_thread_main(void* arg) {
+  unsigned char** objects = arg;
+  for (int i = 0; i < POOL_OBJECTS; i++) {
+    objects[i] = mm_pool_alloc(shared_pool);
+    assert(objects[i] != NULL);
+    assert((uintptr_t)objects[i] % 64 == 0);
+    fill(objects[i], POOL_SIZE, i);
+  }
+  for (int i = 0; i < POOL_OBJECTS; i += 2) {
+    check(objects[i], POOL_SIZE, i);
+    mm_pool_free(shared_pool, objects[i]);
+  }
+  return NULL;
+}
+
+/* Objects from a pool are aligned and distinct, with and without magazines, and the
+   counts add up, also when other threads free what one allocated */
+static void pool_test(void) {
+  static unsigned char* objects[THREADS][POOL_OBJECTS];
+  for (int magazines = 0; magazines <= 1; magazines++) {
+    shared_pool = mm_pool_create(POOL_SIZE, 64);
+    assert(shared_pool != NULL);
+    if (magazines)
+      assert(mm_pool_set_magazines(shared_pool, 32) == 0);
+    pthread_t threads[THREADS];
+    for (int t = 0; t < THREADS; t++)
+      assert(pthread_create(&threads[t], NULL, pool_thread_main, objects[t]) == 0);
+    for (int t = 0; t < THREADS; t++)
+      pthread_join(threads[t], NULL);
+
+    struct mm_pool_stats stats;
+    mm_pool_stats(shared_pool, &stats);
+    assert(stats.object_size == 64);
+    assert(stats.in_use == THREADS * POOL_OBJECTS / 2);
+    assert(stats.allocs == THREADS * POOL_OBJECTS);
+    assert(stats.frees == THREADS * POOL_OBJECTS / 2);
+    /* Exited threads' magazines are back in the pool */
+    assert(stats.cached == 0);
+    assert(stats.slabs * stats.slab_size <= stats.mapped);
+
+    /* The main thread frees the rest */
+    for (int t = 0; t < THREADS; t++) {
+      for (int i = 1; i < POOL_OBJECTS; i += 2) {
+        check(objects[t][i], POOL_SIZE, i);
+        mm_pool_free(shared_pool, objects[t][i]);
+      }
+    }
+    mm_pool_stats(shared_pool, &stats);
+    assert(stats.in_use == 0);
+    /* Only the spare, and slabs of objects in the main thread's magazine, remain */
+    assert(stats.slabs <= 1 + stats.cached);
+    mm_pool_destroy(shared_pool);
+  }
+
+  /* Empty slabs keep their address range, so destroying the pool leaves mappings made
+     since, which could have landed in a range an unmapped slab left, alone */
+  enum { BIG_OBJECTS = 39, BIG_SIZE = 40000, BLOCKS = 8, BLOCK_SIZE = 500000 };
+  mm_pool_t* pool = mm_pool_create(BIG_SIZE, 0);
+  void* big[BIG_OBJECTS];
+  for (int i = 0; i < BIG_OBJECTS; i++)
+    big[i] = mm_pool_alloc(pool);
+  for (int i = 0; i < BIG_OBJECTS; i++)
+    mm_pool_free(pool, big[i]);
+  unsigned char* blocks[BLOCKS];
+  for (int i = 0; i < BLOCKS; i++) {
+    blocks[i] = mm_malloc(BLOCK_SIZE);
+    fill(blocks[i], BLOCK_SIZE, i);
+  }
+  mm_pool_destroy(pool);
+  for (int i = 0; i < BLOCKS; i++) {
+    check(blocks[i], BLOCK_SIZE, i);
+    mm_free(blocks[i]);
+  }
+}
+
+static long rss_kb(void) {
+  long pages = 0, resident = 0;
+  FILE* file = fopen("/proc/self/statm", "r");
+  assert(file != NULL);
+  assert(fscanf(file, "%ld %ld", &pages, &resident) == 2);
+  fclose(file);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Freeing 50 MB lowers the break again, and 50 MB freed below a block still in use gives
+   its pages back */
+static void trim_test(void) {
+  enum { BLOCKS = 256, SIZE = 200 * 1024, MB = 1024 * 1024 };
+  static unsigned char* blocks[BLOCKS];
+  /* The earlier tests' large frees raised the thresholds and left free memory behind that
+     the blocks below would reuse instead of growing the heap */
+  mm_trim(0);
+  char* start = sbrk(0);
+  for (int i = 0; i < BLOCKS; i++) {
+    blocks[i] = mm_malloc(SIZE);
+    fill(blocks[i], SIZE, i);
+  }
+  char* peak = sbrk(0);
+  assert(peak - start >= 40 * MB);
+  for (int i = BLOCKS - 1; i >= 0; i--)
+    mm_free(blocks[i]);
+  /* Free memory goes back once it has stayed free for a while, at the next call after that,
+     even a small one the thread cache serves */
+  usleep(100 * 1000);
+  mm_free(mm_malloc(100));
+  assert(peak - (char*)sbrk(0) >= 32 * MB);
+
+  for (int i = 0; i < BLOCKS; i++) {
+    blocks[i] = mm_malloc(SIZE);
+    fill(blocks[i], SIZE, i);
+  }
+  void* pin = mm_malloc(SIZE);
+  long before = rss_kb();
+  for (int i = 0; i < BLOCKS; i++)
+    mm_free(blocks[i]);
+  /* Behind the pinned block the break cannot move, so the pages are dropped instead */
+  usleep(100 * 1000);
+  mm_free(mm_malloc(100));
+  assert(before - rss_kb() >= 32 * 1024);
+
+  /* The dropped pages come back zeroed, and work as before */
+  for (int i = 0; i < BLOCKS; i++) {
+    blocks[i] = mm_malloc(SIZE);
+    fill(blocks[i], SIZE, i);
+  }
+  for (int i = 0; i < BLOCKS; i++) {
+    check(blocks[i], SIZE, i);
+    mm_free(blocks[i]);
+  }
+  mm_free(pin);
+  mm_trim(0);
+}
+
+static void* small_site(void) { return mm_malloc(100); }
+
+static void* large_site(void) { return mm_malloc(1000); }
+
+/* Samples every allocation from two sites, frees some and resizes one, and checks the
+   counts in the profile's header, objects and bytes live then allocated in all, and that
+   each site has a line of its own with its own counts */
+static void profile_test(void) {
+  void* small[100];
+  void* large[50];
+  mm_profile_start(1);
+  for (int i = 0; i < 100; i++)
+    small[i] = small_site();
+  for (int i = 0; i < 50; i++)
+    large[i] = large_site();
+  for (int i = 0; i < 50; i++)
+    mm_free(small[i]);
+  large[0] = mm_realloc(large[0], 2000);
+
+  char path[] = "/tmp/mm_test.XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  close(fd);
+  assert(mm_profile_dump(path) == 0);
+  mm_profile_start(0);
+  FILE* file = fopen(path, "r");
+  assert(file != NULL);
+  size_t live_count, live_bytes, total_count, total_bytes, interval;
+  assert(fscanf(file, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu", &live_count,
+                &live_bytes, &total_count, &total_bytes, &interval) == 5);
+  /* One line per site, up to the blank line before the mappings: half of small_site's
+     blocks freed, one of large_site's moved by the realloc, which is a site of its own */
+  int sites = 0, small_sites = 0, large_sites = 0, realloc_sites = 0;
+  char line[4096];
+  assert(fgets(line, sizeof(line), file) != NULL);
+  while (fgets(line, sizeof(line), file) != NULL && line[0] != '\n') {
+    size_t count, bytes, all_count, all_bytes;
+    assert(sscanf(line, "%zu: %zu [%zu: %zu] @", &count, &bytes, &all_count, &all_bytes) == 4);
+    sites++;
+    small_sites += count == 50 && bytes == 50 * 100 && all_count == 100 && all_bytes == 100 * 100;
+    large_sites += count == 49 && bytes == 49 * 1000 && all_count == 50 && all_bytes == 50 * 1000;
+    realloc_sites += count == 1 && bytes == 2000 && all_count == 1 && all_bytes == 2000;
+  }
+  fclose(file);
+  assert(sites == 3 && small_sites == 1 && large_sites == 1 && realloc_sites == 1);
+  unlink(path);
+  assert(live_count == 100 && live_bytes == 50 * 100 + 49 * 1000 + 2000);
+  assert(total_count == 151 && total_bytes == 100 * 100 + 50 * 1000 + 2000);
+  assert(interval == 1);
+
+  for (int i = 50; i < 100; i++)
+    mm_free(small[i]);
+  for (int i = 0; i < 50; i++)
+    mm_free(large[i]);
 }
 
 int main() {
@@ -38,4 +373,17 @@ int main() {
   data[0] = 0x162;
   mm_free(data);
   puts("malloc test successful!");
+
+  assert(mm_malloc(0) == NULL);
+  assert(mm_realloc(NULL, 0) == NULL);
+  stress_test(50000, 500);
+  puts("stress test successful!");
+  thread_test();
+  puts("thread test successful!");
+  pool_test();
+  puts("pool test successful!");
+  trim_test();
+  puts("trim test successful!");
+  profile_test();
+  puts("profile test successful!");
 }
@@ -0,0 +1,144 @@
+/*
+ * mm_trace.c
+ *
+ * Records a program's calls to malloc, calloc, realloc and free, for
+ * mm_replay to play back:
+ *
+ *   MM_TRACE=out.trace LD_PRELOAD=./mm_trace.so program args...
+ *
+ * Each call is one line of the trace, with pointers in hex:
+ *
+ *   m SIZE PTR          malloc(SIZE), or calloc() of SIZE bytes in all
+ *   r OLD SIZE PTR      realloc(OLD, SIZE)
+ *   f PTR               free(PTR)
+ *
+ * Aligned allocations are recorded as plain mallocs.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void* (*real_malloc)(size_t);
+static void* (*real_calloc)(size_t, size_t);
+static void* (*real_realloc)(void*, size_t);
+static void (*real_free)(void*);
+static int (*real_posix_memalign)(void**, size_t, size_t);
+
+/* dlsym() may calloc() before the real functions are known; it gets this */
+static char bootstrap[4096];
+static size_t bootstrap_used;
+static int resolving;
+
+static int trace_fd = -1;
+
+static void resolve(void) {
+  resolving = 1;
+  real_malloc = dlsym(RTLD_NEXT, "malloc");
+  real_calloc = dlsym(RTLD_NEXT, "calloc");
+  real_realloc = dlsym(RTLD_NEXT, "realloc");
+  real_free = dlsym(RTLD_NEXT, "free");
+  real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+  resolving = 0;
+}
+
+__attribute__((constructor)) static void trace_open(void) {
+  if (real_malloc == NULL)
+    resolve();
+  const char* path = getenv("MM_TRACE");
+  if (path != NULL) {
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    /* Programs this one runs would start the trace over */
+    unsetenv("MM_TRACE");
+  }
+}
+
+static void record(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+/* Writes a line straight out, so a program killed by a signal leaves a whole trace */
+static void record(const char* format, ...) {
+  if (trace_fd < 0)
+    return;
+  char line[128];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (write(trace_fd, line, len) < 0)
+    trace_fd = -1;
+}
+
+static int from_bootstrap(void* ptr) {
+  return (char*)ptr >= bootstrap && (char*)ptr < bootstrap + sizeof(bootstrap);
+}
+
+void* malloc(size_t size) {
+  if (real_malloc == NULL)
+    resolve();
+  void* p = real_malloc(size);
+  if (p != NULL)
+    record("m %zu %p\n", size, p);
+  return p;
+}
+
+void* calloc(size_t n, size_t size) {
+  if (resolving) {
+    size_t total = (n * size + 15) & ~(size_t)15;
+    if (total > sizeof(bootstrap) - bootstrap_used)
+      return NULL;
+    void* p = bootstrap + bootstrap_used;
+    bootstrap_used += total;
+    return p;
+  }
+  if (real_calloc == NULL)
+    resolve();
+  void* p = real_calloc(n, size);
+  if (p != NULL)
+    record("m %zu %p\n", n * size, p);
+  return p;
+}
+
+void* realloc(void* ptr, size_t size) {
+  if (real_realloc == NULL)
+    resolve();
+  if (from_bootstrap(ptr)) {
+    void* p = malloc(size);
+    if (p != NULL)
+      memcpy(p, ptr, size);
+    return p;
+  }
+  void* p = real_realloc(ptr, size);
+  if (p != NULL || size == 0)
+    record("r %p %zu %p\n", ptr, size, p);
+  return p;
+}
+
+void free(void* ptr) {
+  if (ptr == NULL || from_bootstrap(ptr))
+    return;
+  if (real_free == NULL)
+    resolve();
+  record("f %p\n", ptr);
+  real_free(ptr);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+  if (real_posix_memalign == NULL)
+    resolve();
+  int error = real_posix_memalign(ptr, alignment, size);
+  if (error == 0)
+    record("m %zu %p\n", size, *ptr);
+  return error;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  void* p;
+  return posix_memalign(&p, alignment, size) == 0 ? p : NULL;
+}
+
+void* memalign(size_t alignment, size_t size) { return aligned_alloc(alignment, size); }
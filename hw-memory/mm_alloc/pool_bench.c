@@ -0,0 +1,205 @@
+/*
+ * Measure fixed-size allocation through a pool against mm_malloc and glibc.
+ *
+ * Usage: pool_bench [-t max_threads] [-n ops_per_thread] [-s object_size]
+ *
+ * Each thread keeps 1000 live objects of S bytes (64 by default, about the
+ * size of a work queue item) and, N times, frees a random one and
+ * allocates another in its place. Runs with 1, 2, 4, ... up to T threads
+ * and reports millions of alloc/free pairs per second, for a pool without
+ * magazines, a pool with them, mm_malloc and glibc; then the statistics
+ * of the last pool.
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm_alloc.h"
+
+#define LIVE 1000
+
+enum kind { POOL, POOL_MAGAZINES, MM_MALLOC, GLIBC, NKINDS };
+
+static const char* kind_names[NKINDS] = {"mm_pool", "mm_pool magazines", "mm_malloc", "glibc"};
+
+static int ops = 1000000;
+static size_t object_size = 64;
+
+/* Loaded from hw3lib.so */
+static void* (*mm_malloc_fn)(size_t);
+static void (*mm_free_fn)(void*);
+static mm_pool_t* (*pool_create)(size_t, size_t);
+static int (*pool_set_magazines)(mm_pool_t*, unsigned);
+static void* (*pool_alloc)(mm_pool_t*);
+static void (*pool_free)(mm_pool_t*, void*);
+static void (*pool_stats)(mm_pool_t*, struct mm_pool_stats*);
+static void (*pool_destroy)(mm_pool_t*);
+
+struct worker {
+  pthread_t thread;
+  enum kind kind;
+  mm_pool_t* pool;
+  unsigned seed;
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* load(void* handle, const char* symbol) {
+  void* function = dlsym(handle, symbol);
+  if (function == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  return function;
+}
+
+static void* alloc(struct worker* w) {
+  char* p;
+  switch (w->kind) {
+    case POOL:
+    case POOL_MAGAZINES:
+      p = pool_alloc(w->pool);
+      break;
+    case MM_MALLOC:
+      p = mm_malloc_fn(object_size);
+      break;
+    default:
+      p = malloc(object_size);
+      break;
+  }
+  if (p == NULL) {
+    fprintf(stderr, "%s: out of memory\n", kind_names[w->kind]);
+    exit(1);
+  }
+  p[0] = 1;
+  return p;
+}
+
+static void release(struct worker* w, void* p) {
+  switch (w->kind) {
+    case POOL:
+    case POOL_MAGAZINES:
+      pool_free(w->pool, p);
+      break;
+    case MM_MALLOC:
+      mm_free_fn(p);
+      break;
+    default:
+      free(p);
+      break;
+  }
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  void* live[LIVE];
+  for (int i = 0; i < LIVE; i++)
+    live[i] = alloc(w);
+  for (int op = 0; op < ops; op++) {
+    int i = rand_r(&w->seed) % LIVE;
+    release(w, live[i]);
+    live[i] = alloc(w);
+  }
+  for (int i = 0; i < LIVE; i++)
+    release(w, live[i]);
+  return NULL;
+}
+
+/* Returns millions of alloc/free pairs per second with THREADS threads */
+static double run(enum kind kind, int threads, struct mm_pool_stats* stats) {
+  mm_pool_t* pool = NULL;
+  if (kind == POOL || kind == POOL_MAGAZINES) {
+    pool = pool_create(object_size, 0);
+    if (pool == NULL || (kind == POOL_MAGAZINES && pool_set_magazines(pool, 64) != 0)) {
+      fprintf(stderr, "cannot make a pool of %zu-byte objects\n", object_size);
+      exit(1);
+    }
+  }
+  struct worker* workers = calloc(threads, sizeof(struct worker));
+  double t0 = now();
+  for (int t = 0; t < threads; t++) {
+    workers[t] = (struct worker){.kind = kind, .pool = pool, .seed = t};
+    pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_join(workers[t].thread, NULL);
+  double elapsed = now() - t0;
+  free(workers);
+  if (pool != NULL) {
+    pool_stats(pool, stats);
+    pool_destroy(pool);
+  }
+  return (double)threads * ops / elapsed / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+  int max_threads = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+    switch (opt) {
+      case 't':
+        max_threads = atoi(optarg);
+        break;
+      case 'n':
+        ops = atoi(optarg);
+        break;
+      case 's':
+        object_size = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-t max_threads] [-n ops_per_thread] [-s object_size]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if (max_threads < 1 || ops < 1 || object_size < 1) {
+    fprintf(stderr, "%s: bad argument\n", argv[0]);
+    return 1;
+  }
+
+  void* handle = dlopen("./hw3lib.so", RTLD_NOW);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 1;
+  }
+  mm_malloc_fn = load(handle, "mm_malloc");
+  mm_free_fn = load(handle, "mm_free");
+  pool_create = load(handle, "mm_pool_create");
+  pool_set_magazines = load(handle, "mm_pool_set_magazines");
+  pool_alloc = load(handle, "mm_pool_alloc");
+  pool_free = load(handle, "mm_pool_free");
+  pool_stats = load(handle, "mm_pool_stats");
+  pool_destroy = load(handle, "mm_pool_destroy");
+
+  printf("%d alloc/free pairs of %zu bytes per thread; Mpairs/s\n", ops, object_size);
+  printf("%-8s", "threads");
+  for (int k = 0; k < NKINDS; k++)
+    printf("%19s", kind_names[k]);
+  printf("\n");
+  struct mm_pool_stats stats = {0};
+  for (int threads = 1;; threads = threads * 2 > max_threads ? max_threads : threads * 2) {
+    printf("%-8d", threads);
+    for (int k = 0; k < NKINDS; k++) {
+      printf("%19.2f", run(k, threads, &stats));
+      fflush(stdout);
+    }
+    printf("\n");
+    if (threads == max_threads)
+      break;
+  }
+  printf("\nlast pool: %zu-byte objects, %zu-byte slabs, %zu slabs, %zu KB mapped, "
+         "%zu allocs, %zu frees, %zu in use, %zu cached\n",
+         stats.object_size, stats.slab_size, stats.slabs, stats.mapped / 1024, stats.allocs,
+         stats.frees, stats.in_use, stats.cached);
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Measure how often realloc() resizes a block without copying it.
+ *
+ * Usage: realloc_bench [-v vectors] [-s max_kb]
+ *
+ * Runs growing-vector workloads with mm_alloc (hw3lib.so) and glibc:
+ *
+ *   vector   V arrays grown in turn, each by 1.5 times when full, up to S KB
+ *   string   V strings grown in turn by 1 to 64 bytes at a time, up to S KB
+ *   huge     one array doubled from 4 KB up to 64 times S KB
+ *
+ * For each it reports the time taken, how many reallocs kept the block where
+ * it was, and the bytes copied by the ones that moved it, next to the bytes a
+ * realloc that always allocates, copies and frees would have copied. A moved
+ * block is counted as copied even if the allocator moved it with mremap(), so
+ * in huge only the steps that stay in the heap show as in place: the move into
+ * a mapping and the mremap() moves after it all count, about half the bytes.
+ */
+
+#include <dlfcn.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct allocator {
+  const char* name;
+  const char* library; /* NULL for the C library's malloc */
+  void* (*realloc)(void*, size_t);
+  void (*free)(void*);
+};
+
+static struct allocator allocators[] = {
+    {"mm_alloc", "./hw3lib.so", NULL, NULL},
+    {"glibc", NULL, NULL, NULL},
+};
+
+#define NALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+struct stats {
+  long reallocs;
+  long in_place;
+  uint64_t copied;
+  uint64_t naive; /* What copying on every realloc would cost */
+};
+
+struct vec {
+  char* data;
+  size_t size;
+};
+
+static int nvectors = 64;
+static size_t max_size = 256 * 1024;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Resizes V to SIZE bytes, counting what moved */
+static void resize(struct allocator* alloc, struct stats* stats, struct vec* v, size_t size) {
+  char* p = alloc->realloc(v->data, size);
+  if (p == NULL) {
+    fprintf(stderr, "%s: out of memory\n", alloc->name);
+    exit(1);
+  }
+  if (v->data != NULL) {
+    stats->reallocs++;
+    stats->naive += v->size;
+    if (p == v->data)
+      stats->in_place++;
+    else
+      stats->copied += v->size;
+  }
+  /* Touch the new bytes, as a program filling them would */
+  for (size_t i = v->size; i < size; i += 64)
+    p[i] = 1;
+  p[size - 1] = 1;
+  v->data = p;
+  v->size = size;
+}
+
+static void vector_workload(struct allocator* alloc, struct stats* stats) {
+  struct vec* vecs = calloc(nvectors, sizeof(struct vec));
+  for (int done = 0; done < nvectors;) {
+    done = 0;
+    for (int i = 0; i < nvectors; i++) {
+      size_t size = vecs[i].size < 16 ? 16 : vecs[i].size + vecs[i].size / 2;
+      if (size > max_size)
+        done++;
+      else
+        resize(alloc, stats, &vecs[i], size);
+    }
+  }
+  for (int i = 0; i < nvectors; i++)
+    alloc->free(vecs[i].data);
+  free(vecs);
+}
+
+static void string_workload(struct allocator* alloc, struct stats* stats) {
+  struct vec* vecs = calloc(nvectors, sizeof(struct vec));
+  unsigned seed = 1;
+  for (int done = 0; done < nvectors;) {
+    done = 0;
+    for (int i = 0; i < nvectors; i++) {
+      size_t size = vecs[i].size + 1 + rand_r(&seed) % 64;
+      if (size > max_size)
+        done++;
+      else
+        resize(alloc, stats, &vecs[i], size);
+    }
+  }
+  for (int i = 0; i < nvectors; i++)
+    alloc->free(vecs[i].data);
+  free(vecs);
+}
+
+static void huge_workload(struct allocator* alloc, struct stats* stats) {
+  struct vec v = {NULL, 0};
+  for (size_t size = 4096; size <= 64 * max_size; size *= 2)
+    resize(alloc, stats, &v, size);
+  alloc->free(v.data);
+}
+
+static const struct {
+  const char* name;
+  void (*run)(struct allocator*, struct stats*);
+} workloads[] = {
+    {"vector", vector_workload},
+    {"string", string_workload},
+    {"huge", huge_workload},
+};
+
+int main(int argc, char* argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "v:s:")) != -1) {
+    switch (opt) {
+      case 'v':
+        nvectors = atoi(optarg);
+        break;
+      case 's':
+        max_size = (size_t)atoi(optarg) * 1024;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-v vectors] [-s max_kb]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (nvectors < 1 || max_size < 1024) {
+    fprintf(stderr, "%s: bad argument\n", argv[0]);
+    return 1;
+  }
+
+  for (size_t a = 0; a < NALLOCATORS; a++) {
+    struct allocator* alloc = &allocators[a];
+    if (alloc->library == NULL) {
+      alloc->realloc = realloc;
+      alloc->free = free;
+      continue;
+    }
+    void* handle = dlopen(alloc->library, RTLD_NOW);
+    if (handle == NULL) {
+      fprintf(stderr, "%s\n", dlerror());
+      return 1;
+    }
+    alloc->realloc = dlsym(handle, "mm_realloc");
+    alloc->free = dlsym(handle, "mm_free");
+    if (alloc->realloc == NULL || alloc->free == NULL) {
+      fprintf(stderr, "%s\n", dlerror());
+      return 1;
+    }
+  }
+
+  printf("%-8s %-10s %9s %9s %9s %12s %12s %12s\n", "workload", "allocator", "ms",
+         "reallocs", "in place", "copied KB", "naive KB", "avoided");
+  for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+    for (size_t a = 0; a < NALLOCATORS; a++) {
+      struct stats stats = {0};
+      double t0 = now();
+      workloads[w].run(&allocators[a], &stats);
+      double ms = (now() - t0) * 1e3;
+      printf("%-8s %-10s %9.2f %9ld %8.1f%% %12llu %12llu %11.1f%%\n", workloads[w].name,
+             allocators[a].name, ms, stats.reallocs,
+             100.0 * stats.in_place / (stats.reallocs ? stats.reallocs : 1),
+             (unsigned long long)stats.copied / 1024, (unsigned long long)stats.naive / 1024,
+             100.0 * (stats.naive - stats.copied) / (stats.naive ? stats.naive : 1));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Records the allocation traces mm_replay plays back into traces/:
+#
+#   words.trace   hw-intro's word counter counting the words of a novel
+#   http.trace    hw-http's server answering 600 requests for pages,
+#                 directory listings and missing files
+#
+# Both programs are built first if need be.
+
+set -e
+cd "$(dirname "$0")"
+root=../..
+make -s mm_trace.so
+mkdir -p traces
+tracer=$PWD/mm_trace.so
+
+make -s -C $root/hw-intro/words words
+MM_TRACE=traces/words.trace LD_PRELOAD=$tracer \
+  $root/hw-intro/words/words -f $root/hw-list/gutenberg/sawyer.txt >/dev/null
+
+make -s -C $root/hw-http httpserver
+port=$((20000 + RANDOM % 10000))
+(cd $root/hw-http &&
+  MM_TRACE=$OLDPWD/traces/http.trace LD_PRELOAD=$tracer exec ./httpserver --files www --port $port) >/dev/null 2>&1 &
+server=$!
+trap 'kill $server 2>/dev/null || true' EXIT
+for i in $(seq 50); do
+  curl -s -o /dev/null http://127.0.0.1:$port/ && break
+  sleep 0.1
+done
+for i in $(seq 200); do
+  curl -s -o /dev/null http://127.0.0.1:$port/
+  curl -s -o /dev/null http://127.0.0.1:$port/my_documents/
+  curl -s -o /dev/null http://127.0.0.1:$port/missing.html
+done
+kill -INT $server
+wait $server 2>/dev/null || true
+wc -l traces/*.trace
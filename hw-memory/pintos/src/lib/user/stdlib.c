@@ -0,0 +1,341 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <round.h>
+
+/* User-space dynamic memory allocator, on top of sbrk().
+
+   The heap is a run of chunks between heap_start and the
+   break.  Each chunk starts with a header holding the size of
+   the chunk before it, valid only when that chunk is free, and
+   its own size, whose low bits are flags.  The last chunk,
+   `top', is always free and is never on a free list; it is
+   where the heap grows and shrinks.
+
+   Free chunks are kept on size-class lists: exact classes 8
+   bytes apart for small sizes, then one class per power of 2.
+   malloc() takes the best fit from the first class with a
+   large enough chunk, splitting off the rest, and only then
+   carves from top.  free() merges a chunk with its free
+   neighbours, so no two free chunks are ever adjacent.
+
+   sbrk() is a system call, so the heap grows by at least as
+   much as it already holds, between GROW_MIN and GROW_MAX at a
+   time, and gives memory back with a negative sbrk() only once
+   more than TRIM_THRESHOLD is free at the end. */
+
+/* Chunk header. */
+struct chunk {
+  size_t prev_size;        /* Size of the previous chunk, if free. */
+  size_t size;             /* Size of this chunk, plus flags. */
+  struct chunk* next_free; /* Free list links, in free chunks only. */
+  struct chunk* prev_free;
+};
+
+#define INUSE 1u      /* Chunk is allocated. */
+#define PREV_INUSE 2u /* Previous chunk is allocated. */
+#define FLAGS (INUSE | PREV_INUSE)
+
+#define ALIGN 8                                         /* Payload alignment. */
+#define HEADER offsetof(struct chunk, next_free)        /* Bytes before the payload. */
+#define MIN_CHUNK ROUND_UP(sizeof(struct chunk), ALIGN) /* Smallest chunk. */
+
+#define NSMALL 64                                /* Exact classes, ALIGN apart. */
+#define SMALL_LIMIT (MIN_CHUNK + NSMALL * ALIGN) /* First size past them. */
+#define NCLASSES (NSMALL + 32)                   /* Then one per power of 2. */
+
+#define PAGE_SIZE 4096
+#define GROW_MIN (32 * 1024)        /* Smallest sbrk() increment. */
+#define GROW_MAX (512 * 1024)       /* Largest increment beyond the request. */
+#define TRIM_THRESHOLD (256 * 1024) /* Free bytes at the end before shrinking. */
+#define TOP_PAD (64 * 1024)         /* Free bytes kept at the end after shrinking. */
+
+static struct chunk* freelist[NCLASSES];
+static char* heap_start;
+static char* heap_end; /* The break. */
+static struct chunk* top;
+
+static size_t chunk_size(const struct chunk* c) { return c->size & ~FLAGS; }
+
+static struct chunk* next_chunk(struct chunk* c) {
+  return (struct chunk*)((char*)c + chunk_size(c));
+}
+
+static struct chunk* prev_chunk(struct chunk* c) {
+  return (struct chunk*)((char*)c - c->prev_size);
+}
+
+static void* chunk_to_mem(struct chunk* c) { return (char*)c + HEADER; }
+
+static struct chunk* mem_to_chunk(void* p) { return (struct chunk*)((char*)p - HEADER); }
+
+/* Sets C's size, keeping its flags. */
+static void set_size(struct chunk* c, size_t size) { c->size = size | (c->size & FLAGS); }
+
+/* Marks C free, telling the chunk after it. */
+static void set_free(struct chunk* c) {
+  struct chunk* next = next_chunk(c);
+  c->size &= ~INUSE;
+  next->prev_size = chunk_size(c);
+  next->size &= ~PREV_INUSE;
+}
+
+/* Marks C allocated, telling the chunk after it. */
+static void set_inuse(struct chunk* c) {
+  c->size |= INUSE;
+  next_chunk(c)->size |= PREV_INUSE;
+}
+
+/* Returns the size class of chunks of SIZE bytes. */
+static int size_class(size_t size) {
+  if (size < SMALL_LIMIT)
+    return (size - MIN_CHUNK) / ALIGN;
+  int bit = 31 - __builtin_clz(size);
+  int cls = NSMALL + bit - (31 - __builtin_clz(SMALL_LIMIT));
+  return cls < NCLASSES ? cls : NCLASSES - 1;
+}
+
+static void freelist_insert(struct chunk* c) {
+  struct chunk** head = &freelist[size_class(chunk_size(c))];
+  c->next_free = *head;
+  c->prev_free = NULL;
+  if (*head != NULL)
+    (*head)->prev_free = c;
+  *head = c;
+}
+
+static void freelist_remove(struct chunk* c) {
+  if (c->prev_free != NULL)
+    c->prev_free->next_free = c->next_free;
+  else
+    freelist[size_class(chunk_size(c))] = c->next_free;
+  if (c->next_free != NULL)
+    c->next_free->prev_free = c->prev_free;
+}
+
+/* Returns the chunk size that holds SIZE bytes of payload, or
+   0 if SIZE is too large. */
+static size_t request_size(size_t size) {
+  if (size > SIZE_MAX / 2)
+    return 0;
+  size = ROUND_UP(size + HEADER, ALIGN);
+  return size < MIN_CHUNK ? MIN_CHUNK : size;
+}
+
+/* Removes and returns the smallest free chunk of at least
+   SIZE bytes, or a null pointer if there is none. */
+static struct chunk* find_fit(size_t size) {
+  for (int cls = size_class(size); cls < NCLASSES; cls++) {
+    struct chunk* best = NULL;
+    for (struct chunk* c = freelist[cls]; c != NULL; c = c->next_free) {
+      size_t csize = chunk_size(c);
+      if (csize >= size && (best == NULL || csize < chunk_size(best))) {
+        best = c;
+        if (csize == size)
+          break;
+      }
+    }
+    if (best != NULL) {
+      freelist_remove(best);
+      return best;
+    }
+  }
+  return NULL;
+}
+
+/* Extends the heap so that top holds at least SIZE bytes plus
+   room for its header.  Returns false if sbrk() fails. */
+static bool grow_heap(size_t size) {
+  if (heap_start == NULL) {
+    char* brk = sbrk(0);
+    if (brk == NULL || brk == (void*)-1)
+      return false;
+    size_t pad = ROUND_UP((uintptr_t)brk, ALIGN) - (uintptr_t)brk;
+    if (pad > 0 && sbrk(pad) == (void*)-1)
+      return false;
+    heap_start = heap_end = brk + pad;
+    top = (struct chunk*)heap_start;
+  }
+
+  size_t have = heap_end - (char*)top;
+  if (size > SIZE_MAX - MIN_CHUNK - PAGE_SIZE)
+    return false;
+  size_t need = ROUND_UP(size + MIN_CHUNK - have, PAGE_SIZE);
+
+  /* Grow geometrically, so that N bytes of allocation take
+     O(log N) calls; fall back to just what is needed if the
+     kernel will not give that much. */
+  size_t extra = heap_end - heap_start;
+  if (extra < GROW_MIN)
+    extra = GROW_MIN;
+  if (extra > GROW_MAX)
+    extra = GROW_MAX;
+  char* old = NULL;
+  if (need <= SIZE_MAX - extra && need + extra <= INTPTR_MAX) {
+    old = sbrk(need + extra);
+    if (old != (void*)-1 && old != NULL)
+      need += extra;
+  }
+  if (old == NULL || old == (void*)-1) {
+    if (need > INTPTR_MAX)
+      return false;
+    old = sbrk(need);
+    if (old == NULL || old == (void*)-1)
+      return false;
+  }
+
+  /* A new heap's first chunk has nothing before it to merge with. */
+  size_t flags = heap_end == heap_start ? PREV_INUSE : top->size & FLAGS;
+  heap_end += need;
+  top->size = (heap_end - (char*)top) | flags;
+  return true;
+}
+
+/* Gives the free space at the end of the heap back to the
+   kernel if there is enough of it. */
+static void trim_heap(void) {
+  size_t size = chunk_size(top);
+  if (size <= TRIM_THRESHOLD)
+    return;
+  size_t release = ROUND_DOWN(size - TOP_PAD, PAGE_SIZE);
+  if (release == 0 || sbrk(-(intptr_t)release) == (void*)-1)
+    return;
+  heap_end -= release;
+  set_size(top, size - release);
+}
+
+/* Shrinks allocated chunk C to SIZE bytes, freeing the rest
+   if it is large enough to be a chunk of its own. */
+static void split_chunk(struct chunk* c, size_t size) {
+  size_t rest = chunk_size(c) - size;
+  if (rest < MIN_CHUNK)
+    return;
+  set_size(c, size);
+  struct chunk* r = next_chunk(c);
+  r->size = rest | PREV_INUSE | INUSE;
+  free(chunk_to_mem(r));
+}
+
+/* Takes SIZE bytes off the front of top. */
+static struct chunk* carve_top(size_t size) {
+  if ((top == NULL || chunk_size(top) < size + MIN_CHUNK) && !grow_heap(size))
+    return NULL;
+  struct chunk* c = top;
+  size_t rest = chunk_size(top) - size;
+  set_size(c, size);
+  top = next_chunk(c);
+  top->size = rest;
+  set_inuse(c);
+  return c;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void* malloc(size_t size) {
+  if (size == 0)
+    return NULL;
+  size_t csize = request_size(size);
+  if (csize == 0)
+    return NULL;
+
+  struct chunk* c = find_fit(csize);
+  if (c != NULL) {
+    set_inuse(c);
+    split_chunk(c, csize);
+    return chunk_to_mem(c);
+  }
+  c = carve_top(csize);
+  return c != NULL ? chunk_to_mem(c) : NULL;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void free(void* p) {
+  if (p == NULL)
+    return;
+  struct chunk* c = mem_to_chunk(p);
+  size_t size = chunk_size(c);
+
+  if (!(c->size & PREV_INUSE)) {
+    struct chunk* prev = prev_chunk(c);
+    freelist_remove(prev);
+    size += chunk_size(prev);
+    c = prev;
+  }
+  struct chunk* next = (struct chunk*)((char*)c + size);
+  if (next == top) {
+    c->size = (c->size & PREV_INUSE) | (size + chunk_size(top));
+    top = c;
+    trim_heap();
+    return;
+  }
+  if (!(next->size & INUSE)) {
+    freelist_remove(next);
+    size += chunk_size(next);
+  }
+  c->size = (c->size & PREV_INUSE) | size;
+  set_free(c);
+  freelist_insert(c);
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void* calloc(size_t a, size_t b) {
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  void* p = malloc(a * b);
+  if (p != NULL)
+    memset(p, 0, a * b);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.  If successful, returns the new
+   block; on failure, returns a null pointer and leaves
+   OLD_BLOCK unchanged.  Resizing in place, into a free
+   neighbour or the end of the heap, comes before moving. */
+void* realloc(void* old_block, size_t new_size) {
+  if (old_block == NULL)
+    return malloc(new_size);
+  if (new_size == 0) {
+    free(old_block);
+    return NULL;
+  }
+  size_t csize = request_size(new_size);
+  if (csize == 0)
+    return NULL;
+
+  struct chunk* c = mem_to_chunk(old_block);
+  size_t old_size = chunk_size(c);
+  if (csize <= old_size) {
+    split_chunk(c, csize);
+    return old_block;
+  }
+
+  struct chunk* next = next_chunk(c);
+  if (next == top) {
+    if (chunk_size(top) >= csize - old_size + MIN_CHUNK || grow_heap(csize - old_size)) {
+      size_t rest = chunk_size(top) - (csize - old_size);
+      set_size(c, csize);
+      top = next_chunk(c);
+      top->size = rest | PREV_INUSE;
+      return old_block;
+    }
+  } else if (!(next->size & INUSE) && old_size + chunk_size(next) >= csize) {
+    freelist_remove(next);
+    set_size(c, old_size + chunk_size(next));
+    set_inuse(c);
+    split_chunk(c, csize);
+    return old_block;
+  }
+
+  void* new_block = malloc(new_size);
+  if (new_block == NULL)
+    return NULL;
+  memcpy(new_block, old_block, old_size - HEADER);
+  free(old_block);
+  return new_block;
+}
@@ -0,0 +1,42 @@
+/* Test that malloc() moves the break rarely, and moves it back
+   once everything is freed. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define NUM_SMALL 2000
+#define NUM_LARGE 200
+
+static void* blocks[NUM_SMALL + NUM_LARGE];
+
+void test_main(void) {
+  char* start = sbrk(0);
+  char* brk = start;
+  int moves = 0;
+
+  for (int i = 0; i != NUM_SMALL + NUM_LARGE; i++) {
+    size_t size = i < NUM_SMALL ? 64 : 4096;
+    blocks[i] = malloc(size);
+    ASSERT(blocks[i] != NULL);
+    memset(blocks[i], i, size);
+    if (sbrk(0) != brk) {
+      brk = sbrk(0);
+      moves++;
+    }
+  }
+  ASSERT(moves <= 8);
+
+  for (int i = NUM_SMALL + NUM_LARGE - 1; i >= 0; i--)
+    free(blocks[i]);
+  ASSERT((char*)sbrk(0) - start <= 256 * 1024);
+}
+
+int main(int argc UNUSED, char* argv[] UNUSED) {
+  test_name = "malloc-sbrk";
+  msg("begin");
+  test_main();
+  msg("end");
+  return 0;
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-sbrk) begin
+(malloc-sbrk) end
+malloc-sbrk: exit(0)
+EOF
+pass;
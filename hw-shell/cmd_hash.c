@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cmd_hash.h"
+
+struct cmd_entry {
+  char* name;
+  char* path;
+  unsigned long hits;
+  struct cmd_entry* next;
+};
+
+/* Chained hash table of resolved names, grown to keep chains short */
+static struct cmd_entry** buckets;
+static size_t nbuckets;
+static size_t nentries;
+
+/* The PATH the cached entries were resolved against */
+static char* path_seen;
+
+static uint64_t hash_name(const char* s) {
+  /* FNV-1a */
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (; *s; s++)
+    h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+  return h;
+}
+
+void cmd_hash_clear(void) {
+  for (size_t i = 0; i < nbuckets; i++) {
+    struct cmd_entry* e = buckets[i];
+    while (e != NULL) {
+      struct cmd_entry* next = e->next;
+      free(e->name);
+      free(e->path);
+      free(e);
+      e = next;
+    }
+    buckets[i] = NULL;
+  }
+  nentries = 0;
+}
+
+bool cmd_hash_forget(const char* name) {
+  if (nbuckets == 0)
+    return false;
+  struct cmd_entry** p = &buckets[hash_name(name) & (nbuckets - 1)];
+  for (; *p != NULL; p = &(*p)->next) {
+    if (strcmp((*p)->name, name) == 0) {
+      struct cmd_entry* e = *p;
+      *p = e->next;
+      free(e->name);
+      free(e->path);
+      free(e);
+      nentries--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void cmd_hash_print(void) {
+  if (nentries == 0) {
+    printf("hash: hash table empty\n");
+    return;
+  }
+  printf("hits\tcommand\n");
+  for (size_t i = 0; i < nbuckets; i++)
+    for (struct cmd_entry* e = buckets[i]; e != NULL; e = e->next)
+      printf("%4lu\t%s\n", e->hits, e->path);
+}
+
+/* Drops the table if PATH is not what the entries were resolved against */
+static void check_path(void) {
+  const char* path = getenv("PATH");
+  if (path == NULL)
+    path = "";
+  if (path_seen != NULL && strcmp(path, path_seen) == 0)
+    return;
+  cmd_hash_clear();
+  free(path_seen);
+  path_seen = strdup(path);
+}
+
+static void grow(void) {
+  size_t n = nbuckets ? 2 * nbuckets : 64;
+  struct cmd_entry** b = calloc(n, sizeof(struct cmd_entry*));
+  if (b == NULL)
+    return;
+  for (size_t i = 0; i < nbuckets; i++) {
+    struct cmd_entry* e = buckets[i];
+    while (e != NULL) {
+      struct cmd_entry* next = e->next;
+      size_t j = hash_name(e->name) & (n - 1);
+      e->next = b[j];
+      b[j] = e;
+      e = next;
+    }
+  }
+  free(buckets);
+  buckets = b;
+  nbuckets = n;
+}
+
+/* Probes each directory of PATH for an executable NAME. Returns a malloc'd
+   path, or NULL. An empty PATH entry means the current directory. */
+static char* search_path(const char* name) {
+  size_t name_len = strlen(name);
+  const char* dir = path_seen;
+  for (;;) {
+    const char* end = strchr(dir, ':');
+    size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+    char* file = malloc(dir_len + name_len + 3);
+    if (file == NULL)
+      return NULL;
+    if (dir_len == 0) {
+      strcpy(file, ".");
+    } else {
+      memcpy(file, dir, dir_len);
+      file[dir_len] = '\0';
+    }
+    strcat(file, "/");
+    strcat(file, name);
+    struct stat st;
+    if (access(file, X_OK) == 0 && stat(file, &st) == 0 && S_ISREG(st.st_mode))
+      return file;
+    free(file);
+    if (end == NULL)
+      return NULL;
+    dir = end + 1;
+  }
+}
+
+const char* cmd_hash_lookup(const char* name) {
+  if (name == NULL || name[0] == '\0')
+    return NULL;
+  if (strchr(name, '/') != NULL)
+    return name;
+  check_path();
+  if (nbuckets > 0) {
+    for (struct cmd_entry* e = buckets[hash_name(name) & (nbuckets - 1)]; e; e = e->next) {
+      if (strcmp(e->name, name) == 0) {
+        e->hits++;
+        return e->path;
+      }
+    }
+  }
+
+  /* Only successful lookups are remembered, so a program installed later is
+     found without `hash -r` */
+  char* path = search_path(name);
+  if (path == NULL)
+    return NULL;
+  if (nentries >= nbuckets)
+    grow();
+  struct cmd_entry* e = malloc(sizeof(struct cmd_entry));
+  if (e == NULL || nbuckets == 0) {
+    free(e);
+    free(path);
+    return NULL;
+  }
+  e->name = strdup(name);
+  e->path = path;
+  e->hits = 1;
+  size_t i = hash_name(name) & (nbuckets - 1);
+  e->next = buckets[i];
+  buckets[i] = e;
+  nentries++;
+  return path;
+}
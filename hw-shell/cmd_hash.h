@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+
+/*
+ * A cache of program names resolved against PATH, like bash's hash table.
+ *
+ * Looking a name up probes each PATH directory with access() only the
+ * first time; later lookups are a single hash probe. The whole table is
+ * dropped when PATH changes or on `hash -r`; `hash -d NAME` drops one name.
+ */
+
+/* Returns the full path of program NAME found on PATH, or NULL if there is
+   none. The string is owned by the table and stays valid until the table is
+   next cleared. Names containing '/' are not looked up and are returned as is. */
+const char* cmd_hash_lookup(const char* name);
+
+/* Forgets every cached path. */
+void cmd_hash_clear(void);
+
+/* Drops NAME from the table; returns whether it was there. */
+bool cmd_hash_forget(const char* name);
+
+/* Prints the table as "hits<TAB>path" lines, as bash's `hash` does. */
+void cmd_hash_print(void);
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "job.h"
+
+/* Jobs in order of their ids */
+static struct job* jobs;
+
+/* Readable when SIGCHLD is pending; -1 if signalfd() failed, and waiting blocks in waitpid() */
+static int sigchld_fd = -1;
+
+void job_init(void) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sigchld_fd < 0)
+    perror("signalfd: waiting for children in waitpid() instead");
+}
+
+struct job* job_create(const char* command, bool background) {
+  struct job* job = calloc(1, sizeof(struct job));
+  job->command = strdup(command);
+  job->background = background;
+  job->id = 1;
+  struct job** p = &jobs;
+  for (; *p != NULL; p = &(*p)->next)
+    job->id = (*p)->id + 1;
+  *p = job;
+  return job;
+}
+
+void job_add_proc(struct job* job, pid_t pid) {
+  job->procs = realloc(job->procs, (job->nprocs + 1) * sizeof(struct job_proc));
+  job->procs[job->nprocs++] = (struct job_proc){.pid = pid};
+  if (job->pgid == 0)
+    job->pgid = pid;
+}
+
+void job_remove(struct job* job) {
+  for (struct job** p = &jobs; *p != NULL; p = &(*p)->next) {
+    if (*p == job) {
+      *p = job->next;
+      break;
+    }
+  }
+  free(job->command);
+  free(job->procs);
+  free(job);
+}
+
+struct job* job_find(int id) {
+  struct job* found = NULL;
+  for (struct job* job = jobs; job != NULL; job = job->next)
+    if (id == 0 || job->id == id)
+      found = job;
+  return found;
+}
+
+bool job_is_done(struct job* job) {
+  for (int i = 0; i < job->nprocs; i++)
+    if (!job->procs[i].done)
+      return false;
+  return true;
+}
+
+bool job_is_stopped(struct job* job) {
+  bool stopped = false;
+  for (int i = 0; i < job->nprocs; i++) {
+    if (!job->procs[i].done && !job->procs[i].stopped)
+      return false;
+    stopped |= job->procs[i].stopped;
+  }
+  return stopped;
+}
+
+int job_exit_status(struct job* job) {
+  if (job->nprocs == 0)
+    return 127;
+  int status = job->procs[job->nprocs - 1].status;
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  return WEXITSTATUS(status);
+}
+
+/* Records a state change of process PID */
+static void update_proc(pid_t pid, int status) {
+  for (struct job* job = jobs; job != NULL; job = job->next) {
+    for (int i = 0; i < job->nprocs; i++) {
+      struct job_proc* proc = &job->procs[i];
+      if (proc->pid != pid)
+        continue;
+      if (WIFSTOPPED(status)) {
+        proc->stopped = true;
+        job->notified = false;
+      } else if (WIFCONTINUED(status)) {
+        proc->stopped = false;
+      } else {
+        proc->done = true;
+        proc->stopped = false;
+        proc->status = status;
+      }
+      return;
+    }
+  }
+}
+
+void job_reap(void) {
+  /* Empty the signalfd first: a SIGCHLD that arrives after this reaps a child
+     we will not see below, and leaves the fd readable for the next wait */
+  struct signalfd_siginfo info;
+  while (sigchld_fd >= 0 && read(sigchld_fd, &info, sizeof(info)) == sizeof(info))
+    ;
+  pid_t pid;
+  int status;
+  while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    update_proc(pid, status);
+}
+
+void job_sleep(void) {
+  if (sigchld_fd < 0) {
+    /* Without the signalfd, sleep in waitpid() itself and record what it collects */
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WUNTRACED | WCONTINUED)) < 0 && errno == EINTR)
+      ;
+    if (pid > 0)
+      update_proc(pid, status);
+    return;
+  }
+  struct pollfd pfd = {.fd = sigchld_fd, .events = POLLIN};
+  while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+    ;
+}
+
+void job_wait(struct job* job) {
+  for (;;) {
+    job_reap();
+    if (job_is_done(job) || job_is_stopped(job))
+      return;
+    job_sleep();
+  }
+}
+
+void job_wait_all(void) {
+  for (;;) {
+    job_reap();
+    bool busy = false;
+    for (struct job* job = jobs; job != NULL; job = job->next)
+      busy |= job->background && !job_is_done(job) && !job_is_stopped(job);
+    if (!busy)
+      return;
+    job_sleep();
+  }
+}
+
+void job_print(struct job* job, FILE* out) {
+  const char* state = job_is_done(job) ? "Done" : job_is_stopped(job) ? "Stopped" : "Running";
+  fprintf(out, "[%d]  %-8s %s%s\n", job->id, state, job->command,
+          job->background && !job_is_done(job) && !job_is_stopped(job) ? " &" : "");
+}
+
+void job_notify(bool report, bool all) {
+  job_reap();
+  struct job* next;
+  for (struct job* job = jobs; job != NULL; job = next) {
+    next = job->next;
+    bool stopped = job_is_stopped(job);
+    if (report && (all || (job_is_done(job) && job->background) || (stopped && !job->notified)))
+      job_print(job, stdout);
+    if (job_is_done(job))
+      job_remove(job);
+    else if (stopped)
+      job->notified = true;
+  }
+}
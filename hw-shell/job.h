@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * The shell's job table: every pipeline it launches, in the foreground or
+ * with `&` in the background, until it finishes.
+ *
+ * SIGCHLD is blocked and read from a signalfd instead, so children are
+ * reaped only at points the shell chooses: while it waits for a job, and
+ * before each prompt. Waiting sleeps on the signalfd, never polls; if there
+ * is no signalfd it sleeps in waitpid() instead.
+ */
+
+/* One process of a job */
+struct job_proc {
+  pid_t pid;
+  int status; /* From waitpid(), once done */
+  bool done;
+  bool stopped;
+};
+
+struct job {
+  int id; /* The N of %N */
+  pid_t pgid;
+  char* command;
+  struct job_proc* procs;
+  int nprocs;
+  bool background;
+  bool notified; /* Whether being stopped has been reported */
+  struct job* next;
+};
+
+/* Blocks SIGCHLD and opens the signalfd reaping is driven by. Children must
+   unblock SIGCHLD again; posix_spawn does when given an empty signal mask. */
+void job_init(void);
+
+/* Adds an empty job to the table, numbered one past the highest in use */
+struct job* job_create(const char* command, bool background);
+
+/* Adds process PID to JOB; the first one added leads the job's process group */
+void job_add_proc(struct job* job, pid_t pid);
+
+/* Removes JOB from the table and frees it */
+void job_remove(struct job* job);
+
+/* Returns the job numbered ID, or the most recent one if ID is 0; NULL if there is none */
+struct job* job_find(int id);
+
+/* Whether every process of JOB has finished */
+bool job_is_done(struct job* job);
+
+/* Whether every process of JOB has finished or stopped, and at least one stopped */
+bool job_is_stopped(struct job* job);
+
+/* The exit status of JOB's last process, as a shell reports it */
+int job_exit_status(struct job* job);
+
+/* Collects the status of every child that has changed state, without blocking */
+void job_reap(void);
+
+/* Sleeps until a child may have changed state since the last job_reap() */
+void job_sleep(void);
+
+/* Sleeps until JOB has finished or stopped */
+void job_wait(struct job* job);
+
+/* Sleeps until every background job has finished or stopped */
+void job_wait_all(void);
+
+/* Prints a job and its state as `jobs` lists it */
+void job_print(struct job* job, FILE* out);
+
+/* Reaps, then removes finished jobs and marks stopped ones as reported. With REPORT, prints
+   the finished background jobs and newly stopped ones, or with ALL every job. */
+void job_notify(bool report, bool all);
@@ -0,0 +1,147 @@
+/*
+ * Measure how long the shell takes to launch a command from a script.
+ *
+ * Usage: launch_bench [-n commands] [-d extra_path_dirs] [-s shell]
+ *
+ * Feeds the shell a script of N runs of `true` and reports the time per
+ * command when the program is named by its full path, when it is resolved
+ * through the command hash table, and when the table is emptied with
+ * `hash -r` before every command so that each one probes PATH again.
+ * PATH is prefixed with D directories that do not exist, which a lookup
+ * has to probe before it reaches the real ones. A last script runs the
+ * two-stage pipeline `true | true`.
+ *
+ * Each script is run with both launch paths: posix_spawn, and fork and exec
+ * (`shell -F`). The shell's diagnostic lines are turned off with -q.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs SHELL with the script in FILE as its input; returns seconds taken */
+static double run_script(const char* shell, const char* flag, FILE* file, const char* path) {
+  fflush(file);
+  double t0 = now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    lseek(fileno(file), 0, SEEK_SET);
+    dup2(fileno(file), STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    setenv("PATH", path, 1);
+    execl(shell, shell, "-q", flag, (char*)NULL);
+    perror(shell);
+    _exit(127);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  double elapsed = now() - t0;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "%s exited abnormally\n", shell);
+    exit(1);
+  }
+  return elapsed;
+}
+
+/* Writes a script of N copies of LINES to a temporary file */
+static FILE* make_script(int n, const char* lines) {
+  FILE* file = tmpfile();
+  if (file == NULL) {
+    perror("tmpfile");
+    exit(1);
+  }
+  for (int i = 0; i < n; i++)
+    fputs(lines, file);
+  return file;
+}
+
+int main(int argc, char* argv[]) {
+  int n = 2000;
+  int extra_dirs = 16;
+  const char* shell = "./shell";
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:s:")) != -1) {
+    switch (opt) {
+      case 'n':
+        n = atoi(optarg);
+        break;
+      case 'd':
+        extra_dirs = atoi(optarg);
+        break;
+      case 's':
+        shell = optarg;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n commands] [-d extra_path_dirs] [-s shell]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (n < 1 || extra_dirs < 0) {
+    fprintf(stderr, "%s: invalid arguments\n", argv[0]);
+    return 1;
+  }
+
+  const char* old_path = getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin";
+  size_t path_len = strlen(old_path) + extra_dirs * 32 + 1;
+  char* path = malloc(path_len);
+  path[0] = '\0';
+  for (int i = 0; i < extra_dirs; i++)
+    sprintf(path + strlen(path), "/nonexistent/launch_bench/%d:", i);
+  strcat(path, old_path);
+
+  /* Where `true` is, for the full path case */
+  char true_line[4096] = "";
+  char* dirs = strdup(old_path);
+  char* saveptr;
+  for (char* dir = strtok_r(dirs, ":", &saveptr); dir; dir = strtok_r(NULL, ":", &saveptr)) {
+    snprintf(true_line, sizeof(true_line) - 1, "%s/true", dir);
+    if (access(true_line, X_OK) == 0)
+      break;
+    true_line[0] = '\0';
+  }
+  free(dirs);
+  if (true_line[0] == '\0') {
+    fprintf(stderr, "%s: cannot find true on PATH\n", argv[0]);
+    return 1;
+  }
+  strcat(true_line, "\n");
+
+  struct {
+    const char* name;
+    const char* lines;
+  } cases[] = {
+      {"full path", true_line},
+      {"hashed", "true\n"},
+      {"hash -r", "hash -r\ntrue\n"},
+      {"pipeline", "true | true\n"},
+  };
+
+  printf("%d commands, %d extra PATH directories\n", n, extra_dirs);
+  printf("%-10s %-6s %12s %12s\n", "case", "launch", "us/command", "commands/s");
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    FILE* script = make_script(n, cases[i].lines);
+    double spawn = run_script(shell, NULL, script, path);
+    double fork = run_script(shell, "-F", script, path);
+    printf("%-10s %-6s %12.1f %12.0f\n", cases[i].name, "spawn", spawn / n * 1e6, n / spawn);
+    printf("%-10s %-6s %12.1f %12.0f\n", "", "fork", fork / n * 1e6, n / fork);
+    fclose(script);
+  }
+  free(path);
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "line_reader.h"
+
+struct line_reader {
+  int fd;
+  size_t block;
+  char* buf;
+  size_t size;
+  size_t start; /* First byte not yet returned */
+  size_t end;   /* End of the bytes read */
+  int eof;
+};
+
+struct line_reader* line_reader_create(int fd, size_t block) {
+  struct line_reader* reader = calloc(1, sizeof(struct line_reader));
+  reader->fd = fd;
+  reader->block = block;
+  reader->size = block + 1;
+  reader->buf = malloc(reader->size);
+  return reader;
+}
+
+char* line_reader_next(struct line_reader* reader) {
+  size_t scanned = reader->start;
+  for (;;) {
+    char* newline = memchr(reader->buf + scanned, '\n', reader->end - scanned);
+    if (newline != NULL) {
+      char* line = reader->buf + reader->start;
+      *newline = '\0';
+      reader->start = newline + 1 - reader->buf;
+      return line;
+    }
+    if (reader->eof) {
+      if (reader->start == reader->end)
+        return NULL;
+      /* A last line without a newline; there is always room for the NUL */
+      char* line = reader->buf + reader->start;
+      reader->buf[reader->end] = '\0';
+      reader->start = reader->end;
+      return line;
+    }
+
+    /* Move the partial line to the front, and make room for a block after it */
+    scanned = reader->end - reader->start;
+    memmove(reader->buf, reader->buf + reader->start, scanned);
+    reader->start = 0;
+    reader->end = scanned;
+    if (reader->size - reader->end < reader->block + 1) {
+      while (reader->size - reader->end < reader->block + 1)
+        reader->size *= 2;
+      reader->buf = realloc(reader->buf, reader->size);
+    }
+    ssize_t n;
+    while ((n = read(reader->fd, reader->buf + reader->end, reader->block)) < 0 && errno == EINTR)
+      ;
+    if (n <= 0)
+      reader->eof = 1;
+    else
+      reader->end += n;
+  }
+}
+
+void line_reader_sync(struct line_reader* reader) {
+  size_t ahead = reader->end - reader->start;
+  if (ahead > 0 && lseek(reader->fd, -(off_t)ahead, SEEK_CUR) >= 0) {
+    reader->end = reader->start;
+    reader->eof = 0;
+  }
+}
+
+void line_reader_destroy(struct line_reader* reader) {
+  if (reader == NULL)
+    return;
+  free(reader->buf);
+  free(reader);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Reads lines of any length from a file descriptor, a large block at a
+ * time. The buffer grows to hold the longest line seen.
+ */
+struct line_reader;
+
+/* Read lines from FD, asking for BLOCK bytes per read() */
+struct line_reader* line_reader_create(int fd, size_t block);
+
+/* Returns the next line without its newline, or NULL at the end of the input. The line
+   lives in the reader's buffer, which may be modified, until the next call. */
+char* line_reader_next(struct line_reader* reader);
+
+/* Hand back the input read past the last line returned, by seeking FD back to the end of
+   that line if FD can seek. A child that reads the same file then starts at the next line. */
+void line_reader_sync(struct line_reader* reader);
+
+/* Free the reader; FD is left open */
+void line_reader_destroy(struct line_reader* reader);
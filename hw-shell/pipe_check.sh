@@ -0,0 +1,35 @@
+#!/bin/sh
+# Pipe a file far larger than a pipe buffer through several filters in the
+# shell, with both launch paths, and compare the result with /bin/sh's.
+# A pipeline whose stages ran one after another would block on the first
+# full pipe, so each run is given a time limit.
+#
+# Usage: pipe_check.sh [megabytes] [shell]
+
+mb=${1:-64}
+shell=${2:-./shell}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# Lines of a few words, so the filters have something to do
+seq 1 $((mb * 1024 * 1024 / 24)) | sed 's/$/ alpha beta gamma/' | head -c $((mb * 1024 * 1024)) \
+  > "$dir/in.txt"
+pipeline="cat $dir/in.txt | tr a-z A-Z | grep -v 7 | cut -d ' ' -f 1,3 | wc -c"
+expect=$(sh -c "$pipeline")
+
+status=0
+for flag in "" -F; do
+  start=$(date +%s%N)
+  # Into a file, as stuck stages would keep a command substitution open
+  echo "$pipeline" | timeout 60 $shell $flag > "$dir/out.txt"
+  got=$(grep -v '^SHELL pid\|^SPAWN' "$dir/out.txt")
+  end=$(date +%s%N)
+  if [ "$got" = "$expect" ]; then
+    result=ok
+  else
+    result="FAILED (expected $expect, got ${got:-nothing})"
+    status=1
+  fi
+  echo "shell ${flag:-(spawn)}: $mb MB through 5 stages in $(((end - start) / 1000000)) ms: $result"
+done
+exit $status
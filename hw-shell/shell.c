@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -7,12 +8,19 @@
 #include <string.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <spawn.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "cmd_hash.h"
+#include "job.h"
+#include "line_reader.h"
 #include "tokenizer.h"
 
+extern char** environ;
+
 /* Convenience macro to silence compiler warnings about unused function parameters. */
 #define unused __attribute__((unused))
 
@@ -28,10 +36,41 @@ struct termios shell_tmodes;
 /* Process group id for the shell */
 pid_t shell_pgid;
 
+/* Launch commands with fork and exec instead of posix_spawn */
+bool fork_launch;
+
+/* Whether posix_spawn can hand a child the terminal before it runs (glibc 2.35). Without it
+   interactive foreground jobs are forked, or they could touch the tty while still in the
+   background and be stopped by SIGTTOU. */
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define SPAWN_TCSETPGRP true
+#else
+#define SPAWN_TCSETPGRP false
+#endif
+
+/* Where commands are read from: standard input, or the script given with -f */
+int shell_input = STDIN_FILENO;
+
+/* Whether to print the process and process group diagnostics (off with -q) */
+bool shell_diagnostics = true;
+
+/* Print a diagnostic line; the arguments are not evaluated when they are off */
+#define diag(...)                                                                                  \
+  do {                                                                                             \
+    if (shell_diagnostics)                                                                         \
+      printf(__VA_ARGS__);                                                                         \
+  } while (0)
+
 int cmd_exit(struct tokens* tokens);
 int cmd_help(struct tokens* tokens);
 int cmd_pwd(struct tokens* tokens);
 int cmd_cd(struct tokens* tokens);
+int cmd_hash(struct tokens* tokens);
+int cmd_jobs(struct tokens* tokens);
+int cmd_fg(struct tokens* tokens);
+int cmd_bg(struct tokens* tokens);
+int cmd_wait(struct tokens* tokens);
+int cmd_parallel(struct tokens* tokens);
 
 /* Built-in command functions take token array (see parse.h) and return int */
 typedef int cmd_fun_t(struct tokens* tokens);
@@ -46,7 +85,14 @@ typedef struct fun_desc {
 fun_desc_t cmd_table[] = {{cmd_help, "?", "show this help menu"},
                           {cmd_exit, "exit", "exit the command shell"},
                           {cmd_pwd, "pwd", "print the current working directory"},
-                          {cmd_cd, "cd", "change the current working directory"}};
+                          {cmd_cd, "cd", "change the current working directory"},
+                          {cmd_hash, "hash", "show remembered program paths, or forget them (-r, -d NAME)"},
+                          {cmd_jobs, "jobs", "list the jobs"},
+                          {cmd_fg, "fg", "continue a job (%N, or the latest) in the foreground"},
+                          {cmd_bg, "bg", "continue a stopped job (%N, or the latest) in the background"},
+                          {cmd_wait, "wait", "wait for a background job (%N), or for all of them"},
+                          {cmd_parallel, "parallel",
+                           "run a command once per argument after :::, -j N at a time, -k in order"}};
 
 /* Prints a helpful description for the given command */
 int cmd_help(unused struct tokens* tokens) {
@@ -75,6 +121,27 @@ int cmd_cd(struct tokens* tokens) {
   return 1;
 }
 
+/* Shows, forgets (-r, or -d for the names after it) or remembers the given programs'
+   PATH resolutions */
+int cmd_hash(struct tokens* tokens) {
+  size_t n = tokens_get_length(tokens);
+  if (n == 1) {
+    cmd_hash_print();
+    return 1;
+  }
+  bool forget = false;
+  for (size_t i = 1; i < n; i++) {
+    char* arg = tokens_get_token(tokens, i);
+    if (strcmp(arg, "-r") == 0)
+      cmd_hash_clear();
+    else if (strcmp(arg, "-d") == 0)
+      forget = true;
+    else if (forget ? !cmd_hash_forget(arg) : cmd_hash_lookup(arg) == NULL)
+      fprintf(stderr, "hash: %s: not found\n", arg);
+  }
+  return 1;
+}
+
 /* Looks up the built-in command, if it exists. */
 int lookup(char cmd[]) {
   for (unsigned int i = 0; i < sizeof(cmd_table) / sizeof(fun_desc_t); i++)
@@ -88,8 +155,8 @@ void init_shell() {
   /* Our shell is connected to standard input. */
   shell_terminal = STDIN_FILENO;
 
-  /* Check if we are running interactively */
-  shell_is_interactive = isatty(shell_terminal);
+  /* Check if we are running interactively; a script never is */
+  shell_is_interactive = shell_input == STDIN_FILENO && isatty(shell_terminal);
 
   if (shell_is_interactive) {
     /* If the shell is not currently in the foreground, we must pause the shell until it becomes a
@@ -109,36 +176,15 @@ void init_shell() {
   }
 }
 
-/*
-Get the environment variable PATH, and split them into string array
-*/
-char** get_env_path(size_t* sz) {
-  char** PATH = malloc(100 * sizeof(char*));
-  *sz = 0;
-  char* pathvar = getenv("PATH");
-  char* saveptr;
-  char* token;
-  token = strtok_r(pathvar, ":", &saveptr);
-  while (token) {
-    PATH[*sz] = malloc(strlen(token) + 1);
-    strcpy(PATH[*sz], token);
-    (*sz)++;
-    token = strtok_r(NULL, ":", &saveptr);
-  }
-  return PATH;
-}
-
 /*
 Get program params
 */
 char** get_params(struct tokens* tokens, size_t* n) {
   *n = tokens_get_length(tokens);
   char** params = malloc((*n + 1) * sizeof(char*));
-  for (int i = 0; i < (*n); ++i) {
-    char* arg = tokens_get_token(tokens, i);
-    params[i] = malloc(strlen(arg) + 1);
-    strcpy(params[i], arg);
-  }
+  //The words stay in the tokenizer's arena until the next line
+  for (int i = 0; i < (*n); ++i)
+    params[i] = tokens_get_token(tokens, i);
   params[*n] = NULL;
   return params;
 }
@@ -160,21 +206,35 @@ bool isvalid(const char* path) {
 }
 
 /*
-If the path is not absolute path, make it a absolute path
+Resolve the program of a command: a path is run as is, a name is looked up on PATH
+through the command hash table, and a name not on PATH may still be a file in cwd
 */
-char* make_abs_path(const char* path, char** PATH, const int sz) {
-  for (int i = 0; i < sz; ++i) {
-    char* dir = malloc(100);
-    dir[0] = '\0';
-    strcat(dir, PATH[i]);
-    strcat(dir, "/");
-    strcat(dir, path);
-    if (access(dir, F_OK) == 0)
-      return dir;
-    else
-      free(dir);
+const char* resolve_prog(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return name;
+  const char* path = cmd_hash_lookup(name);
+  if (path == NULL && isvalid(name))
+    path = name;
+  return path;
+}
+
+/*
+Resolve the program of every stage of a pipeline, leaving NULL for those not found
+*/
+const char** resolve_pipeline(char** params, const size_t n) {
+  const char** progs = calloc(n + 2, sizeof(char*));
+  size_t stage = 0;
+  bool stage_start = true;
+  for (size_t i = 0; i < n; ++i) {
+    if (strcmp(params[i], "|") == 0) {
+      stage++;
+      stage_start = true;
+    } else if (stage_start) {
+      progs[stage] = resolve_prog(params[i]);
+      stage_start = false;
+    }
   }
-  return NULL;
+  return progs;
 }
 
 /*
@@ -192,7 +252,7 @@ void process_redirection(char** params, const size_t n) {
       outfd = creat(filename, 0644);
       if (outfd < 0) {
         perror("open output file fails");
-        exit(0);
+        _exit(1);
       }
       dup2(outfd, STDOUT_FILENO);
       close(outfd);
@@ -205,7 +265,7 @@ void process_redirection(char** params, const size_t n) {
       infd = open(filename, O_RDONLY);
       if (infd == -1) {
         perror("open input file fails");
-        exit(0);
+        _exit(1);
       }
       dup2(infd, STDIN_FILENO);
       close(infd);
@@ -234,25 +294,44 @@ void open_signal() {
 }
 
 /* Execute the single program, support the redirection and path resolution*/
-void exec_prog(char** params, const int n, char** PATH, const int sz) {
-  char* filepath = isvalid(params[0]) ? params[0] : make_abs_path(params[0], PATH, sz);
+void exec_prog(const char* prog, char** params, const int n) {
+  if (prog == NULL) {
+    fprintf(stderr, "%s: command not found\n", params[0]);
+    _exit(127);
+  }
   process_redirection(params, n);
-  execv(filepath, params);
+  execv(prog, params);
+  perror(params[0]);
+  //Not exit(), which would run the shell's atexit handlers and flush its streams
+  _exit(126);
 }
 
-/* Spawn the child process*/
-void spawn_proc(int in, int fd[2], char** argv, int argc, char** PATH, const size_t sz) {
+/* Fork one stage of a pipeline into JOB's process group, or a new group if it has none yet.
+   The stage reads IN and writes FD[1]; FD[0] is the next stage's end, or -1. */
+pid_t spawn_proc(int in, int fd[2], struct job* job, const char* prog, char** argv, int argc) {
   pid_t pid;
-  int status;
+  pid_t pgid = job->pgid;
+  //Flush first, or the child would print our buffered output again
+  fflush(stdout);
   pid = fork();
   if (pid < 0) {
     perror("Fork fails");
-    exit(0);
+    return -1;
   } else if (pid == 0) {
+    //Join the pipeline's process group and take the terminal while the signals are still ignored
+    setpgid(0, pgid);
+    if (shell_is_interactive && !job->background)
+      tcsetpgrp(shell_terminal, getpgrp());
+    open_signal();
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    diag("SPAWN:pid: %d, SPAWN pgid: %d, terminal foreground pgid: %d\n", getpid(),
+         getpgid(getpid()), tcgetpgrp(0));
+    fflush(stdout);
     //There is no need for current program to read from the current pipe
-    printf("SPAWN:pid: %d, SPAWN pgid: %d, terminal foreground pgid: %d\n", getpid(),
-           getpgid(getpid()), tcgetpgrp(0));
-    close(fd[0]);
+    if (fd[0] >= 0)
+      close(fd[0]);
     //Redirect the standard input to in, which is the pipe containing the result of last program
     if (in != STDIN_FILENO) {
       dup2(in, STDIN_FILENO);
@@ -264,136 +343,530 @@ void spawn_proc(int in, int fd[2], char** argv, int argc, char** PATH, const siz
       dup2(fd[1], STDOUT_FILENO);
       close(fd[1]);
     }
-    exec_prog(argv, argc, PATH, sz);
-  } else {
-    //Control center should not have access to write fd of current pipe
-    close(fd[1]);
-    //The read fd of last pipe is no longer needed
-    if (in != 0)
-      close(in);
-    //Control center only needs the read fd of current pipe and wait for the current program done.
-    wait(&status);
+    exec_prog(prog, argv, argc);
   }
+  //Set the group here too, so it exists whichever of us runs first
+  setpgid(pid, pgid ? pgid : pid);
+  job_add_proc(job, pid);
+  //The shell should not keep the write fd of current pipe
+  if (fd[1] != STDOUT_FILENO)
+    close(fd[1]);
+  //The read fd of last pipe is no longer needed
+  if (in != STDIN_FILENO)
+    close(in);
+  return pid;
 }
 
 char** get_pipe_params(char** params, int start, int argc) {
   char** argv = malloc((argc + 1) * sizeof(char*));
-  for (int j = 0; j < argc; ++j) {
-    argv[j] = malloc(strlen(params[start + j]) + 1);
-    strcpy(argv[j], params[start + j]);
-  }
+  for (int j = 0; j < argc; ++j)
+    argv[j] = params[start + j];
   argv[argc] = NULL;
   return argv;
 }
 
-/* Execute the program depending on whether that the command is pipeline or single program*/
-void fork_pipes(char** params, const int n, char** PATH, const size_t sz) {
-  //Split out to be a single process group
-  setpgid(getpid(), getpid());
-  //Make me the foreground process group of the terminal because terminal will only send signal to foreground process group
-  tcsetpgrp(0, getpid());
-  //Open the signal
-  open_signal();
-  printf("CENTER pid: %d, CENTER pgid: %d, terminal foreground pgid: %d\n", getpid(),
-         getpgid(getpid()), tcgetpgrp(0));
+/* Fork every stage of the pipeline from the shell into JOB */
+void fork_pipes(char** params, const int n, const char** progs, struct job* job) {
   int start = 0;
-  bool foundPipe = false;
-  int in = 0, fd[2];
-  for (int i = 0; i < n; ++i) {
-    //Find a pipe command
-    if (strcmp(params[i], "|") == 0) {
-      foundPipe = true;
-      int argc = i - start;
-      char** argv = get_pipe_params(params, start, argc);
-      //Generate the pipe for the pipe command
-      if (pipe(fd) != 0) {
-        perror("Pile fails");
-        exit(0);
+  int in = STDIN_FILENO;
+  for (int i = 0; i <= n; ++i) {
+    //Find the end of a stage
+    if (i < n && strcmp(params[i], "|") != 0)
+      continue;
+    int argc = i - start;
+    char** argv = get_pipe_params(params, start, argc);
+    //The last stage writes to standard output, the others to a new pipe
+    int fd[2] = {-1, STDOUT_FILENO};
+    if (i < n && pipe(fd) != 0) {
+      perror("Pipe fails");
+      free(argv);
+      break;
+    }
+    spawn_proc(in, fd, job, *progs++, argv, argc);
+    free(argv);
+    //the next program will read from the read fd of current pipe
+    in = fd[0];
+    start = i + 1;
+  }
+  if (in >= 0 && in != STDIN_FILENO)
+    close(in);
+}
+
+/*
+Add the file actions of the redirections in PARAMS[start, end) to ACTIONS and
+copy the remaining words to ARGV. Returns false if a redirection has no file.
+*/
+bool spawn_redirection(char** params, int start, int end, posix_spawn_file_actions_t* actions,
+                       char** argv) {
+  int argc = 0;
+  for (int i = start; i < end; i++) {
+    bool out = strcmp(params[i], ">") == 0;
+    if (out || strcmp(params[i], "<") == 0) {
+      if (++i == end) {
+        fprintf(stderr, "missing file for %s\n", out ? ">" : "<");
+        return false;
       }
-      spawn_proc(in, fd, argv, argc, PATH, sz);
-      //the next program will read from the read fd of current pipe
-      in = fd[0];
-      start = i + 1;
+      if (out)
+        posix_spawn_file_actions_addopen(actions, STDOUT_FILENO, params[i],
+                                         O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      else
+        posix_spawn_file_actions_addopen(actions, STDIN_FILENO, params[i], O_RDONLY, 0);
+    } else {
+      argv[argc++] = params[i];
     }
   }
-  if (foundPipe) {
-    //Execute the final program and output should be sent to standard output
-    printf("FINAL SPAWN pid: %d, FIANL SPAWN pgid: %d, terminal foreground pgid: %d\n", getpid(),
-           getpgid(getpid()), tcgetpgrp(0));
-    int argc = n - start;
-    char** argv = get_pipe_params(params, start, argc);
+  argv[argc] = NULL;
+  return true;
+}
+
+/*
+Launch every stage of the pipeline into JOB straight from the shell with posix_spawn,
+which needs no copy of the shell's address space. The stages go into a new process
+group, whose leader takes the terminal before it runs unless the job is in the background.
+*/
+void spawn_pipeline(char** params, const int n, const char** progs, struct job* job) {
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  posix_spawnattr_setsigmask(&attr, &sigs);
+  //The shell ignores these, and ignored signals stay ignored across exec
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGQUIT);
+  sigaddset(&sigs, SIGTSTP);
+  sigaddset(&sigs, SIGCONT);
+  sigaddset(&sigs, SIGTTIN);
+  sigaddset(&sigs, SIGTTOU);
+  posix_spawnattr_setsigdefault(&attr, &sigs);
+  posix_spawnattr_setflags(&attr,
+                           POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+  char** argv = malloc((n + 1) * sizeof(char*));
+  int in = STDIN_FILENO;
+  int start = 0;
+  for (int stage = 0; start <= n; stage++) {
+    int end = start;
+    while (end < n && strcmp(params[end], "|") != 0)
+      end++;
+    bool last = end == n;
+    //Pipes are close-on-exec, so each stage keeps only the ends it dup2()s
+    int fd[2] = {-1, STDOUT_FILENO};
+    if (!last && pipe2(fd, O_CLOEXEC) != 0) {
+      perror("Pipe fails");
+      break;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
     if (in != STDIN_FILENO)
-      dup2(in, STDIN_FILENO);
-    exec_prog(argv, argc, PATH, sz);
+      posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    if (fd[1] != STDOUT_FILENO)
+      posix_spawn_file_actions_adddup2(&actions, fd[1], STDOUT_FILENO);
+#if SPAWN_TCSETPGRP
+    //The leader takes the terminal itself, before exec, while its signals are still blocked
+    if (job->nprocs == 0 && shell_is_interactive && !job->background)
+      posix_spawn_file_actions_addtcsetpgrp_np(&actions, shell_terminal);
+#endif
+    if (spawn_redirection(params, start, end, &actions, argv)) {
+      const char* prog = progs[stage];
+      pid_t pid;
+      int err;
+      posix_spawnattr_setpgroup(&attr, job->pgid);
+      if (prog == NULL) {
+        fprintf(stderr, "%s: command not found\n", argv[0] ? argv[0] : "");
+      } else if ((err = posix_spawn(&pid, prog, &actions, &attr, argv, environ)) != 0) {
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+      } else {
+        job_add_proc(job, pid);
+      }
+    }
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (in != STDIN_FILENO)
+      close(in);
+    if (fd[1] != STDOUT_FILENO)
+      close(fd[1]);
+    in = fd[0];
+    start = end + 1;
   }
-  //No pipe command
-  else {
-    printf("PROC IN CENTER pid: %d, PROC IN CENTER pgid: %d, terminal foreground pgid: %d\n",
-           getpid(), getpgid(getpid()), tcgetpgrp(0));
-    exec_prog(params, n, PATH, sz);
+  if (in != STDIN_FILENO && in >= 0)
+    close(in);
+  free(argv);
+  posix_spawnattr_destroy(&attr);
+}
+
+/* Wait for JOB in the foreground, giving it the terminal, and continue it first if
+   CONT. The terminal comes back to the shell when the job finishes or stops. */
+void put_in_foreground(struct job* job, bool cont) {
+  job->background = false;
+  if (shell_is_interactive)
+    tcsetpgrp(shell_terminal, job->pgid);
+  if (cont)
+    kill(-job->pgid, SIGCONT);
+  job_wait(job);
+  if (shell_is_interactive) {
+    tcsetpgrp(shell_terminal, shell_pgid);
+    tcsetattr(shell_terminal, TCSADRAIN, &shell_tmodes);
+  }
+  if (job_is_stopped(job)) {
+    printf("\n");
+    job_print(job, stdout);
+    job->notified = true;
+  } else {
+    job_remove(job);
+  }
+}
+
+/* The job named by the argument of fg, bg or wait: %N or N, or the most recent job */
+struct job* job_argument(struct tokens* tokens, const char* cmd) {
+  char* arg = tokens_get_token(tokens, 1);
+  int id = 0;
+  if (arg != NULL && (id = atoi(arg[0] == '%' ? arg + 1 : arg)) <= 0) {
+    fprintf(stderr, "%s: %s: no such job\n", cmd, arg);
+    return NULL;
   }
+  struct job* job = job_find(id);
+  if (job == NULL)
+    fprintf(stderr, "%s: %s: no such job\n", cmd, arg ? arg : "current");
+  return job;
 }
 
-int main(unused int argc, unused char* argv[]) {
+/* List the jobs */
+int cmd_jobs(unused struct tokens* tokens) {
+  job_notify(true, true);
+  return 1;
+}
+
+/* Continue a job in the foreground */
+int cmd_fg(struct tokens* tokens) {
+  struct job* job = job_argument(tokens, "fg");
+  if (job != NULL) {
+    printf("%s\n", job->command);
+    fflush(stdout);
+    put_in_foreground(job, true);
+  }
+  return 1;
+}
+
+/* Continue a stopped job in the background */
+int cmd_bg(struct tokens* tokens) {
+  struct job* job = job_argument(tokens, "bg");
+  if (job != NULL) {
+    job->background = true;
+    kill(-job->pgid, SIGCONT);
+    printf("[%d] %s &\n", job->id, job->command);
+  }
+  return 1;
+}
+
+/* Wait for a background job, or all of them */
+int cmd_wait(struct tokens* tokens) {
+  if (tokens_get_length(tokens) == 1) {
+    job_wait_all();
+  } else {
+    struct job* job = job_argument(tokens, "wait");
+    if (job != NULL)
+      job_wait(job);
+  }
+  return 1;
+}
+
+/* Launch the pipeline in PARAMS as a new job; returns NULL if no process of it started */
+struct job* launch_job(char** params, const size_t n, bool background) {
+  size_t length = 0;
+  for (size_t i = 0; i < n; ++i)
+    length += strlen(params[i]) + 1;
+  char* command = malloc(length);
+  command[0] = '\0';
+  for (size_t i = 0; i < n; ++i) {
+    strcat(command, params[i]);
+    if (i + 1 < n)
+      strcat(command, " ");
+  }
+  struct job* job = job_create(command, background);
+  free(command);
+
+  const char** progs = resolve_pipeline(params, n);
+  fflush(stdout);
+  if (fork_launch || (!SPAWN_TCSETPGRP && shell_is_interactive && !background))
+    fork_pipes(params, n, progs, job);
+  else
+    spawn_pipeline(params, n, progs, job);
+  free(progs);
+
+  if (job->nprocs == 0) {
+    job_remove(job);
+    return NULL;
+  }
+  return job;
+}
+
+/* Run the pipeline in PARAMS as a new job, waiting for it unless it is in the BACKGROUND */
+void run_command(char** params, const size_t n, bool background) {
+  struct job* job = launch_job(params, n, background);
+  if (job == NULL)
+    return;
+  if (!background)
+    put_in_foreground(job, false);
+  else if (shell_is_interactive)
+    printf("[%d] %d\n", job->id, job->pgid);
+}
+
+/* One command of parallel: its job, and where its output waits its turn with -k */
+struct parallel_cmd {
+  struct job* job;
+  char output[32];
+  bool done;
+};
+
+/* Copy the output file of a command run by parallel -k to standard output, and delete it */
+void parallel_output(struct parallel_cmd* cmd) {
+  //A command whose file could not be made was never run
+  if (cmd->output[0] == '\0')
+    return;
+  FILE* file = fopen(cmd->output, "r");
+  if (file != NULL) {
+    char buf[8192];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+      fwrite(buf, 1, n, stdout);
+    fclose(file);
+  }
+  unlink(cmd->output);
+}
+
+/* Return a copy of WORD with every {} replaced by ARG */
+char* replace_braces(const char* word, const char* arg) {
+  size_t count = 0;
+  for (const char* p = word; (p = strstr(p, "{}")) != NULL; p += 2)
+    count++;
+  char* result = malloc(strlen(word) + count * strlen(arg) + 1);
+  char* out = result;
+  for (const char* p; (p = strstr(word, "{}")) != NULL; word = p + 2) {
+    memcpy(out, word, p - word);
+    out = stpcpy(out + (p - word), arg);
+  }
+  strcpy(out, word);
+  return result;
+}
+
+/*
+Run CMD once per argument after :::, up to N at a time, as background jobs. Each argument
+replaces every {} in the words of CMD, or is appended to them if there is none. With -k the outputs
+are printed in the order of the arguments instead of as they are written.
+*/
+int cmd_parallel(struct tokens* tokens) {
+  size_t ntokens = tokens_get_length(tokens);
+  long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  bool keep_order = false;
+  size_t i = 1;
+  for (; i < ntokens; i++) {
+    char* arg = tokens_get_token(tokens, i);
+    if (strcmp(arg, "-k") == 0)
+      keep_order = true;
+    else if (strncmp(arg, "-j", 2) == 0 && (arg[2] != '\0' || ++i < ntokens))
+      max_jobs = atol(arg[2] != '\0' ? arg + 2 : tokens_get_token(tokens, i));
+    else
+      break;
+  }
+  size_t cmd_start = i;
+  while (i < ntokens && strcmp(tokens_get_token(tokens, i), ":::") != 0)
+    i++;
+  size_t cmd_words = i - cmd_start;
+  if (i == ntokens || cmd_words == 0 || max_jobs < 1) {
+    fprintf(stderr, "usage: parallel [-j N] [-k] command [args] ::: arguments...\n");
+    return 1;
+  }
+  size_t args_start = i + 1;
+  size_t nargs = ntokens - args_start;
+
+  bool has_braces = false;
+  for (i = 0; i < cmd_words; i++)
+    has_braces |= strstr(tokens_get_token(tokens, cmd_start + i), "{}") != NULL;
+  //The command's words, the argument if appended, and "> file" with -k
+  char** params = malloc((cmd_words + 4) * sizeof(char*));
+  char** replaced = calloc(cmd_words, sizeof(char*));
+  struct parallel_cmd* cmds = calloc(nargs, sizeof(struct parallel_cmd));
+  size_t next = 0, printed = 0, failed = 0;
+  long running = 0;
+  while (printed < nargs) {
+    //Start commands until N are running
+    while (running < max_jobs && next < nargs) {
+      struct parallel_cmd* cmd = &cmds[next];
+      char* arg = tokens_get_token(tokens, args_start + next++);
+      if (keep_order) {
+        strcpy(cmd->output, "/tmp/parallel.XXXXXX");
+        int fd = mkstemp(cmd->output);
+        if (fd < 0) {
+          fprintf(stderr, "parallel: %s: %s\n", arg, strerror(errno));
+          cmd->output[0] = '\0';
+          cmd->done = true;
+          failed++;
+          continue;
+        }
+        close(fd);
+      }
+      size_t n = 0;
+      for (i = 0; i < cmd_words; i++) {
+        char* word = tokens_get_token(tokens, cmd_start + i);
+        if (strstr(word, "{}") != NULL)
+          word = replaced[i] = replace_braces(word, arg);
+        params[n++] = word;
+      }
+      if (!has_braces)
+        params[n++] = arg;
+      if (keep_order) {
+        params[n++] = ">";
+        params[n++] = cmd->output;
+      }
+      params[n] = NULL;
+      cmd->job = launch_job(params, n, true);
+      for (i = 0; i < cmd_words; i++) {
+        free(replaced[i]);
+        replaced[i] = NULL;
+      }
+      if (cmd->job == NULL) {
+        cmd->done = true;
+        failed++;
+      } else {
+        running++;
+      }
+    }
+
+    //Collect the commands that finished, then print what is next in order
+    job_reap();
+    bool progress = false;
+    for (i = printed; i < next; i++) {
+      struct parallel_cmd* cmd = &cmds[i];
+      if (cmd->done || !job_is_done(cmd->job))
+        continue;
+      failed += job_exit_status(cmd->job) != 0;
+      job_remove(cmd->job);
+      cmd->done = true;
+      running--;
+      progress = true;
+    }
+    for (; printed < next && cmds[printed].done; printed++) {
+      if (keep_order)
+        parallel_output(&cmds[printed]);
+      progress = true;
+    }
+    if (!progress)
+      job_sleep();
+  }
+  fflush(stdout);
+  if (failed > 0)
+    fprintf(stderr, "parallel: %zu of %zu commands failed\n", failed, nargs);
+  free(cmds);
+  free(replaced);
+  free(params);
+  return 1;
+}
+
+/* Commands run from the script, and when it started, for the throughput report */
+static unsigned long script_commands;
+static struct timespec script_start;
+
+/* Report script throughput on stderr; runs at exit, so `exit` in a script reports too */
+void report_script(void) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fflush(stdout);
+  double elapsed =
+      (end.tv_sec - script_start.tv_sec) + (end.tv_nsec - script_start.tv_nsec) / 1e9;
+  fprintf(stderr, "%lu commands in %.3f s, %.0f commands/s\n", script_commands, elapsed,
+          elapsed > 0 ? script_commands / elapsed : 0.0);
+}
+
+int main(int argc, char* argv[]) {
+  const char* script = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "Ff:q")) != -1) {
+    switch (opt) {
+      case 'F':
+        fork_launch = true;
+        break;
+      case 'f':
+        script = optarg;
+        break;
+      case 'q':
+        shell_diagnostics = false;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-F] [-q] [-f script]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (script != NULL) {
+    shell_input = open(script, O_RDONLY | O_CLOEXEC);
+    if (shell_input < 0) {
+      perror(script);
+      return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &script_start);
+    atexit(report_script);
+  }
+
   init_shell();
-  tcsetpgrp(0, getpid());
+  if (shell_is_interactive)
+    tcsetpgrp(0, getpid());
   ignore_signal();
-  printf("SHELL pid: %d, SHELL pgid: %d terminal foreground pgid: %d\n", getpid(),
-         getpgid(getpid()), tcgetpgrp(0));
-  static char line[4096];
+  job_init();
+  diag("SHELL pid: %d, SHELL pgid: %d terminal foreground pgid: %d\n", getpid(),
+       getpgid(getpid()), tcgetpgrp(0));
+  /* Scripts are read in large blocks; standard input is shared with the commands, and
+     handed back after each line, so it is read in smaller ones */
+  struct line_reader* reader =
+      line_reader_create(shell_input, shell_input == STDIN_FILENO ? 4096 : 65536);
+  char* line;
   int line_num = 0;
+  /* One list of words for every line, so a line costs no allocations once it has grown */
+  struct tokens* tokens = tokens_create();
 
   /* Please only print shell prompts when standard input is not a tty */
   if (shell_is_interactive)
     fprintf(stdout, "%d: ", line_num);
+  /* The reader does not flush stdout before reading, as stdio does for a terminal */
+  fflush(stdout);
 
-  while (fgets(line, 4096, stdin)) {
+  while ((line = line_reader_next(reader)) != NULL) {
     /* Split our line into words. */
-    struct tokens* tokens = tokenize(line);
+    tokenize_into(tokens, line);
+    if (shell_input == STDIN_FILENO && tokens_get_length(tokens) > 0)
+      line_reader_sync(reader);
 
     /* Find which built-in function to run. */
     int fundex = lookup(tokens_get_token(tokens, 0));
 
+    if (tokens_get_length(tokens) > 0)
+      script_commands++;
     if (fundex >= 0) {
       cmd_table[fundex].fun(tokens);
-    } else {
+    } else if (tokens_get_length(tokens) > 0) {
       /* REPLACE this to run commands as programs. */
       //fprintf(stdout, "This shell doesn't know how to run programs.\n");
-      int status;
-      pid_t pid;
-      pid = fork();
-      if (pid < 0) {
-        perror("fork");
-        exit(EXIT_FAILURE);
-      }
-      //child process
-      else if (pid == 0) {
-        //Get the environment "PATH"
-        //printf("Here is child\n");
-        size_t sz = 0;
-        char** PATH = get_env_path(&sz);
-        size_t n = 0;
-        char** params = get_params(tokens, &n);
-        //Current process is a "control center", it forks the process to realize the series pipe command
-        fork_pipes(params, n, PATH, sz);
-      }
-      //parent process
-      else {
-        //printf("Here is parent\n");
-        wait(&status);
-        //printf("Child returns and here is parent\n");
-      }
+      size_t n = 0;
+      char** params = get_params(tokens, &n);
+      //A trailing & runs the command in the background
+      bool background = strcmp(params[n - 1], "&") == 0;
+      if (background)
+        params[--n] = NULL;
+      if (n > 0)
+        run_command(params, n, background);
+      free(params);
     }
-    //My foreground position was taken over by my child and now I take it back
-    tcsetpgrp(0, getpid());
-    printf("SHELL pid: %d, SHELL pgid: %d terminal foreground pgid: %d\n", getpid(),
-           getpgid(getpid()), tcgetpgrp(0));
+    //Report the background jobs that finished while this command ran
+    job_notify(shell_is_interactive, false);
+    diag("SHELL pid: %d, SHELL pgid: %d terminal foreground pgid: %d\n", getpid(),
+         getpgid(getpid()), tcgetpgrp(0));
     if (shell_is_interactive)
       /* Please only print shell prompts when standard input is not a tty */
       fprintf(stdout, "%d: ", ++line_num);
-
-    /* Clean up memory */
-    tokens_destroy(tokens);
+    fflush(stdout);
   }
+
+  /* Clean up memory */
+  tokens_destroy(tokens);
+  line_reader_destroy(reader);
   return 0;
 }
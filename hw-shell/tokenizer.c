@@ -6,96 +6,86 @@
 struct tokens {
   size_t tokens_length;
   char** tokens;
-  size_t buffers_length;
-  char** buffers;
+  size_t tokens_capacity;
+  /* The words, one after another, each ending in a NUL */
+  char* arena;
+  size_t arena_size;
 };
 
-static void* vector_push(char*** pointer, size_t* size, void* elem) {
-  *pointer = (char**)realloc(*pointer, sizeof(char*) * (*size + 1));
-  (*pointer)[*size] = elem;
-  *size += 1;
-  return elem;
+struct tokens* tokens_create(void) {
+  struct tokens* tokens = (struct tokens*)calloc(1, sizeof(struct tokens));
+  tokens->arena_size = 256;
+  tokens->arena = (char*)malloc(tokens->arena_size);
+  return tokens;
 }
 
-static void* copy_word(char* source, size_t n) {
-  source[n] = '\0';
-  char* word = (char*)malloc(n + 1);
-  strncpy(word, source, n + 1);
-  return word;
+/* Grow *ARRAY of *CAPACITY elements of SIZE bytes to hold at least N, doubling */
+static void reserve(void* array, size_t* capacity, size_t size, size_t n) {
+  if (n <= *capacity)
+    return;
+  size_t c = *capacity ? *capacity : 16;
+  while (c < n)
+    c *= 2;
+  *(void**)array = realloc(*(void**)array, c * size);
+  *capacity = c;
 }
 
-struct tokens* tokenize(const char* line) {
-  if (line == NULL) {
+struct tokens* tokenize_into(struct tokens* tokens, const char* line) {
+  if (tokens == NULL || line == NULL) {
     return NULL;
   }
 
-  static char token[4096];
-  size_t n = 0, n_max = 4096;
-  struct tokens* tokens;
+  /* Words never hold more characters than the line, plus one NUL per word, which needs a
+     separator after it except for the last. So the arena never fills mid-line. */
   size_t line_length = strlen(line);
-
-  tokens = (struct tokens*)malloc(sizeof(struct tokens));
+  reserve(&tokens->arena, &tokens->arena_size, 1, line_length + 1);
+  char* token = tokens->arena;
+  size_t n = 0;
   tokens->tokens_length = 0;
-  tokens->tokens = NULL;
-  tokens->buffers_length = 0;
-  tokens->buffers = NULL;
 
   const int MODE_NORMAL = 0, MODE_SQUOTE = 1, MODE_DQUOTE = 2;
   int mode = MODE_NORMAL;
 
-  for (unsigned int i = 0; i < line_length; i++) {
+  for (size_t i = 0; i < line_length; i++) {
     char c = line[i];
-    if (mode == MODE_NORMAL) {
-      if (c == '\'') {
-        mode = MODE_SQUOTE;
-      } else if (c == '"') {
-        mode = MODE_DQUOTE;
-      } else if (c == '\\') {
-        if (i + 1 < line_length) {
-          token[n++] = line[++i];
-        }
-      } else if (isspace(c)) {
-        if (n > 0) {
-          void* word = copy_word(token, n);
-          vector_push(&tokens->tokens, &tokens->tokens_length, word);
-          n = 0;
-        }
-      } else {
-        token[n++] = c;
-      }
-    } else if (mode == MODE_SQUOTE) {
-      if (c == '\'') {
-        mode = MODE_NORMAL;
-      } else if (c == '\\') {
-        if (i + 1 < line_length) {
-          token[n++] = line[++i];
-        }
-      } else {
-        token[n++] = c;
+    if (mode == MODE_NORMAL && isspace(c)) {
+      if (n > 0) {
+        token[n] = '\0';
+        reserve(&tokens->tokens, &tokens->tokens_capacity, sizeof(char*), tokens->tokens_length + 1);
+        tokens->tokens[tokens->tokens_length++] = token;
+        token += n + 1;
+        n = 0;
       }
-    } else if (mode == MODE_DQUOTE) {
-      if (c == '"') {
-        mode = MODE_NORMAL;
-      } else if (c == '\\') {
-        if (i + 1 < line_length) {
-          token[n++] = line[++i];
-        }
-      } else {
-        token[n++] = c;
+    } else if (c == '\\') {
+      if (i + 1 < line_length) {
+        token[n++] = line[++i];
       }
+    } else if (mode == MODE_NORMAL && c == '\'') {
+      mode = MODE_SQUOTE;
+    } else if (mode == MODE_NORMAL && c == '"') {
+      mode = MODE_DQUOTE;
+    } else if ((mode == MODE_SQUOTE && c == '\'') || (mode == MODE_DQUOTE && c == '"')) {
+      mode = MODE_NORMAL;
+    } else {
+      token[n++] = c;
     }
-    if (n + 1 >= n_max)
-      abort();
   }
 
   if (n > 0) {
-    void* word = copy_word(token, n);
-    vector_push(&tokens->tokens, &tokens->tokens_length, word);
-    n = 0;
+    token[n] = '\0';
+    reserve(&tokens->tokens, &tokens->tokens_capacity, sizeof(char*), tokens->tokens_length + 1);
+    tokens->tokens[tokens->tokens_length++] = token;
   }
   return tokens;
 }
 
+struct tokens* tokenize(const char* line) {
+  if (line == NULL) {
+    return NULL;
+  }
+  return tokenize_into(tokens_create(), line);
+}
+
 size_t tokens_get_length(struct tokens* tokens) {
   if (tokens == NULL) {
     return 0;
@@ -116,14 +106,7 @@ void tokens_destroy(struct tokens* tokens) {
   if (tokens == NULL) {
     return;
   }
-  for (int i = 0; i < tokens->tokens_length; i++) {
-    free(tokens->tokens[i]);
-  }
-  for (int i = 0; i < tokens->buffers_length; i++) {
-    free(tokens->buffers[i]);
-  }
-  if (tokens->tokens) {
-    free(tokens->tokens);
-  }
+  free(tokens->arena);
+  free(tokens->tokens);
   free(tokens);
 }
@@ -3,9 +3,16 @@
 /* A struct that represents a list of words. */
 struct tokens;
 
-/* Turn a string into a list of words. */
+/* Turn a string of any length into a list of words, stored together in one arena. */
 struct tokens* tokenize(const char* line);
 
+/* Make an empty list of words for tokenize_into() to fill */
+struct tokens* tokens_create(void);
+
+/* Replace the words in TOKENS with the words of a new line. The words are stored in an
+   arena owned by TOKENS that is reused for every line, and stay valid until the next call. */
+struct tokens* tokenize_into(struct tokens* tokens, const char* line);
+
 /* How many words are there? */
 size_t tokens_get_length(struct tokens* tokens);
 